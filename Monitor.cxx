@@ -6,6 +6,9 @@ Tristan Protzman, 27-08-2024
 #include "Monitor.h"
 
 #include "file_stream.h"
+#include "udp_stream.h"
+#include "compressed_stream.h"
+#include "run_header.h"
 #include "line_stream.h"
 #include "channel_stream.h"
 #include "configuration.h"
@@ -14,6 +17,11 @@ Tristan Protzman, 27-08-2024
 #include "event_builder.h"
 #include "online_monitor.h"
 #include "decoders.h"
+#include "load_shedder.h"
+#include "shm_export.h"
+#include "aggregator_stream.h"
+#include "delta_sender.h"
+#include "metrics.h"
 
 #include <TROOT.h>
 #include <TH1.h>
@@ -45,11 +53,15 @@ void signal_handler(int signal) {
     stop = true;
 }
 
-void run_monitoring(int run, int debug, bool isPostAna=false) {
+//********************************************************************************************
+// Runs are read one after the other by the same monitor.  The next one is started once the
+// current run has no more data and the next run's file exists.
+//********************************************************************************************
+void run_monitoring(std::vector<int> runs, std::string config_file, int debug, bool isPostAna=false, uint32_t window_start=0, uint32_t window_end=0) {
     std::cout << "Real decoding started" << std::endl;
     auto s = server::get_instance()->get_server();
     auto start_time = std::chrono::high_resolution_clock::now();
-    auto m = new online_monitor(run, debug);
+    auto m = new online_monitor(runs[0], debug);
     auto line_numbers = new TH1I("line_numbers", "Line Numbers", 5, 0, 5);
 
     // Some histograms to check the data rates from each board/asic
@@ -61,7 +73,7 @@ void run_monitoring(int run, int debug, bool isPostAna=false) {
     for (int i = 0; i < 16; i++) {
         data_rates->GetXaxis()->SetBinLabel(i + 1, readout_label[i]);
     }
-    s->Register("/QA Plots/DAQ Performance/", data_rates);
+    server::get_instance()->register_object("/QA Plots/DAQ Performance/", data_rates);
 
     auto dir = getenv("DATA_DIRECTORY");
     if (dir == nullptr) {
@@ -71,13 +83,60 @@ void run_monitoring(int run, int debug, bool isPostAna=false) {
         return;
     }
 
-    const char *fname = Form("%s/Run%03d.h2g", dir, run);
-    file_stream fs(fname);
+    auto run_file = [dir](int run) {return std::string(Form("%s/Run%03d.h2g", dir, run));};
+    size_t next_run = 1;
+    // Packets come from the run file, an archived compressed run, or straight from the network.
+    // Only the plain file can seek, checkpoint and move on to the next run.
+    packet_stream *input;
+    file_stream *fs = nullptr;
+    auto udp_port = configuration::get_instance()->UDP_PORT;
+    bool aggregating = !configuration::get_instance()->AGGREGATOR_LISTEN.empty();
+    if (aggregating) {
+        input = new aggregator_stream(configuration::get_instance()->AGGREGATOR_LISTEN.c_str());
+        next_run = runs.size();
+    } else if (udp_port > 0) {
+        input = new udp_stream(udp_port);
+        next_run = runs.size();
+    } else if (decompressor::is_compressed(find_run_file(run_file(runs[0])))) {
+        input = new compressed_stream(find_run_file(run_file(runs[0])));
+        if (runs.size() > 1) {
+            std::cerr << "Compressed runs are read one per process, only doing run " << runs[0] << std::endl;
+        }
+        next_run = runs.size();
+    } else {
+        fs = new file_stream(run_file(runs[0]).c_str());
+        input = fs;
+    }
+    load_shedder shedder;
+    // Everything is registered by now, so the export can lay out its segment
+    shm_export *exporter = nullptr;
+    if (!configuration::get_instance()->SHM_EXPORT.empty()) {
+        exporter = new shm_export(configuration::get_instance()->SHM_EXPORT.c_str());
+    }
+    auto checkpoint_interval = configuration::get_instance()->CHECKPOINT_INTERVAL;
+    // Workers only hold their share of the data, the aggregator has the full picture
+    delta_sender *sender = nullptr;
+    if (!configuration::get_instance()->AGGREGATOR.empty()) {
+        sender = new delta_sender(configuration::get_instance()->AGGREGATOR.c_str());
+    }
+    bool checkpointing = fs != nullptr && sender == nullptr && !isPostAna && checkpoint_interval > 0;
+    auto last_checkpoint = std::chrono::high_resolution_clock::now();
+    auto display_interval = configuration::get_instance()->EVENT_DISPLAY_INTERVAL;
+    auto last_display = std::chrono::high_resolution_clock::now();
+    if (window_start > 0 && fs != nullptr) {
+        if (!fs->seek_to_time(window_start)) {
+            std::cerr << "Starting from the beginning of the run instead" << std::endl;
+        }
+    } else if (checkpointing) {
+        // Restarted in the middle of a run, pick up from the last checkpoint
+        m->restore_checkpoint(*fs);
+    }
     uint8_t buffer[configuration::get_instance()->PACKET_SIZE];
     uint32_t heartbeat_seconds = 0;
     uint32_t heartbeat_milliseconds = 0;
 
     bool all_events_built = false;
+    bool drained = false;       // Read the current file dry since the next one showed up
     for (int iteration = 0; iteration < 10000000; iteration++) {
         if (stop) {
             break;
@@ -85,37 +144,137 @@ void run_monitoring(int run, int debug, bool isPostAna=false) {
         m->check_reset();
 
         s->ProcessRequests();
+        // The event display has its own, faster clock, and only ever draws the newest event
+        if (display_interval > 0 && std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - last_display).count() >= display_interval) {
+            {
+                stage_timer build_timer(metrics::BUILD);
+                m->build_events();
+            }
+            m->make_event_display();
+            last_display = std::chrono::high_resolution_clock::now();
+        }
         if (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start_time).count() > 4) {
+            stage_timer refresh_timer(metrics::REFRESH);
             std::cout << "Building events...";
-            m->build_events();
+            {
+                stage_timer build_timer(metrics::BUILD);
+                m->build_events();
+            }
             std::cout << " done!" << std::endl;
             std::cout << "Updating canvases...";
-            fs.print_packet_numbers();
+            input->print_packet_numbers();
+            if (fs != nullptr) {
+                fs->save_index();
+            }
+            shedder.update(input->get_backlog());
+            metrics::get_instance()->backlog_bytes = input->get_backlog();
+            metrics::get_instance()->prescale = shedder.get_prescale();
+            if (checkpointing && std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - last_checkpoint).count() >= checkpoint_interval) {
+                m->save_checkpoint(*fs);
+                last_checkpoint = std::chrono::high_resolution_clock::now();
+            }
             m->update_builder_graphs();
+            // These rebuild histograms from what this process decoded, which would wipe what the workers sent
+            if (!aggregating) {
+                m->update_windows();
+                m->update_pedestals();
+                m->update_occupancy();
+                m->update_zero_suppression();
+            }
+            m->update_pulse_template();
+            m->update_pulse_display();
             m->update_canvases();
+            if (sender != nullptr) {
+                sender->send(m->get_run_number(), input);
+            }
+            if (exporter != nullptr) {
+                exporter->snapshot(m->get_run_number());
+            }
             gSystem->ProcessEvents();
             start_time = std::chrono::high_resolution_clock::now();
-            // m->make_event_display();
             std::cout << " done!" << std::endl;
             all_events_built = true;
         }
-        int good_data = fs.read_packet(buffer);
+        auto read_start = std::chrono::steady_clock::now();
+        int good_data = input->read_packet(buffer);
         if (!good_data) {
-            if (isPostAna && all_events_built) {
+            // The DAQ may still have written to this file between the empty read and seeing the
+            // next one, so read it dry once more before moving on
+            bool next_segment = fs != nullptr && fs->has_next_segment();
+            bool next_run_ready = !next_segment && next_run < runs.size() && all_events_built && (isPostAna || !gSystem->AccessPathName(run_file(runs[next_run]).c_str()));
+            if ((next_segment || next_run_ready) && !drained) {
+                drained = true;
+                continue;
+            }
+            drained = false;
+            if (next_segment && fs->next_segment()) {
+                continue;
+            }
+            if (next_run_ready) {
+                int run = runs[next_run++];
+                // Everything is allocated for the current readout, the next run has to match it
+                auto config = configuration::get_instance();
+                auto layout = config->layout();
+                load_configs(config_file, run, debug);
+                auto new_layout = config->layout();
+                bool compatible = true;
+                for (size_t i = 0; i < layout.size(); i++) {
+                    if (new_layout[i].second != layout[i].second) {
+                        std::cerr << "Run " << run << " has a different " << layout[i].first << " (" << new_layout[i].second << " instead of " << layout[i].second << "), stopping here" << std::endl;
+                        compatible = false;
+                    }
+                }
+                if (!compatible) {
+                    break;
+                }
+                if (checkpointing) {
+                    m->save_checkpoint(*fs);
+                }
+                m->start_run(run);
+                if (!fs->open_run(run_file(run).c_str())) {
+                    std::cerr << "Could not open run " << run << ", stopping here" << std::endl;
+                    break;
+                }
+                if (checkpointing) {
+                    m->restore_checkpoint(*fs);
+                }
+                all_events_built = false;
+                continue;
+            }
+            // A compressed run can come up empty while it waits for the decompression thread
+            if (isPostAna && all_events_built && next_run >= runs.size() && input->finished()) {
                 std::cout << "All events built, exiting..." << std::endl;
                 break;
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+            // Wake up as soon as the DAQ writes more, but still come back often enough to serve http requests
+            input->wait_for_data(100);
             continue;
         }
         all_events_built = false;
+        drained = false;
+        metrics::get_instance()->add_time(metrics::READ, std::chrono::steady_clock::now() - read_start);
         if (good_data == 2) {
             // std::cout << "Heartbeat packet" << std::endl;
             heartbeat_seconds = bit_converter(buffer, 12, false);
             heartbeat_milliseconds = bit_converter(buffer, 16, false);
+            if (window_end > 0 && heartbeat_seconds > window_end) {
+                std::cout << "Reached end of requested time window" << std::endl;
+                break;
+            }
             // std::cout << "Heartbeat: " << heartbeat_seconds << "." << heartbeat_milliseconds << std::endl;
             continue;
         }
+        // Packet is already counted by the file stream, we just don't decode it
+        if (!shedder.accept()) {
+            continue;
+        }
+        // Another worker decodes this FPGA
+        uint32_t packet_number, fpga_id;
+        classify_packet(buffer, packet_number, fpga_id);
+        if (!configuration::get_instance()->reads_fpga(fpga_id)) {
+            continue;
+        }
+        stage_timer decode_timer(metrics::DECODE);
         //*****************************************************************************************
         // 2024 data format - 1G
         //*****************************************************************************************
@@ -135,20 +294,34 @@ void run_monitoring(int run, int debug, bool isPostAna=false) {
             m->update_events();
         }
     }
+    if (checkpointing) {
+        m->save_checkpoint(*fs);
+    }
+    delete exporter;
+    delete sender;
     delete m;
+    delete input;
 }
 
-int Monitor(int run, std::string config_file, int debug, bool isPostAna = false) {
+int Monitor(std::vector<int> runs, std::string config_file, int debug, bool isPostAna = false, uint32_t start_time = 0, uint32_t end_time = 0) {
+    if (runs.empty()) {
+        std::cerr << "No runs given" << std::endl;
+        return 1;
+    }
     // register signal handler
     signal(SIGINT, signal_handler);
 
     gStyle->SetOptStat(0);
-    load_configs(config_file, run, debug);  // Always load the config before starting 
+    load_configs(config_file, runs[0], debug);  // Always load the config before starting 
     print_configs();
-    run_monitoring(run, debug, isPostAna);
+    run_monitoring(runs, config_file, debug, isPostAna, start_time, end_time);
     return 0;
 }
 
+int Monitor(int run, std::string config_file, int debug, bool isPostAna = false, uint32_t start_time = 0, uint32_t end_time = 0) {
+    return Monitor(std::vector<int>{run}, config_file, debug, isPostAna, start_time, end_time);
+}
+
 int main() {
     TApplication app("app", 0, nullptr);
     Monitor(42, "", 0);  // answer to the universe
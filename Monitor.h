@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
-int Monitor(int run, std::string config_file, int debug, bool isPostAna);
+// start_time and end_time are heartbeat times (unix seconds), 0 to process the whole run
+int Monitor(int run, std::string config_file, int debug, bool isPostAna, uint32_t start_time, uint32_t end_time);
+// Read the runs one after the other in the same process, the time window only applies to the first
+int Monitor(std::vector<int> runs, std::string config_file, int debug, bool isPostAna, uint32_t start_time, uint32_t end_time);
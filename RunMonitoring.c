@@ -2,11 +2,22 @@
 #include <TSystem.h>
 #include <THttpServer.h>
 
-void RunMonitoring(int run = 1, TString configName="lfhcal_10sample_testORNLSumV1_test.cfg", int debug = 0, bool isPostAna = false) {
+void RunMonitoring(int run = 1, TString configName="lfhcal_10sample_testORNLSumV1_test.cfg", int debug = 0, bool isPostAna = false, unsigned int startTime = 0, unsigned int endTime = 0) {
 	  gSystem->Load("libRHTTP.so");
     gSystem->Load("libMonitoring.so");
     // Monitor(run, "generic_20sample.cfg");
     // Monitor(run, "eeemcal_20sample.cfg");
-    Monitor(run, configName.Data(), debug, isPostAna);
+    Monitor(run, configName.Data(), debug, isPostAna, startTime, endTime);
     // Monitor(run, "lfhcal_10sample.cfg", debug, isPostAna);
 }
+
+// Monitor first_run, first_run + 1, ..., last_run with one server, moving on to the next run once its file appears
+void RunMonitoringSequence(int first_run, int last_run, TString configName="lfhcal_10sample_testORNLSumV1_test.cfg", int debug = 0, bool isPostAna = false) {
+    gSystem->Load("libRHTTP.so");
+    gSystem->Load("libMonitoring.so");
+    std::vector<int> runs;
+    for (int run = first_run; run <= last_run; run++) {
+        runs.push_back(run);
+    }
+    Monitor(runs, configName.Data(), debug, isPostAna, 0, 0);
+}
@@ -0,0 +1,206 @@
+#include "aggregator_stream.h"
+
+#include "delta_protocol.h"
+#include "configuration.h"
+#include "server.h"
+
+#include <TH1.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//********************************************************************************************
+// Listen for workers.  Everything has been registered by the time the input is created.
+//********************************************************************************************
+aggregator_stream::aggregator_stream(const char *address) {
+    bytes_received = 0;
+    for (auto &entry : server::get_instance()->get_registered()) {
+        auto hist = dynamic_cast<TH1*>(entry.second);
+        if (hist != nullptr) {
+            histograms.emplace(entry.first + "/" + hist->GetName(), hist);
+        }
+    }
+    listen_fd = delta_listen(address);
+    if (listen_fd < 0) {
+        throw std::runtime_error("Error listening for workers");
+    }
+    std::cout << "Waiting for workers at " << address << std::endl;
+}
+
+aggregator_stream::~aggregator_stream() {
+    for (auto &w : workers) {
+        if (w.fd >= 0) {
+            close(w.fd);
+        }
+    }
+    close(listen_fd);
+}
+
+void aggregator_stream::accept_worker() {
+    int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+        perror("accept");
+        return;
+    }
+    // Reuse the slot of a worker that has gone, so reconnects don't grow the list
+    size_t slot = 0;
+    while (slot < workers.size() && workers[slot].fd >= 0) {
+        slot++;
+    }
+    if (slot == workers.size()) {
+        workers.emplace_back();
+    }
+    workers[slot].fd = fd;
+    workers[slot].buffer.clear();
+    workers[slot].targets.clear();
+    std::cout << "Worker " << slot << " connected" << std::endl;
+}
+
+//********************************************************************************************
+// Serve the workers until the timeout.  This is the aggregator's whole data path.
+//********************************************************************************************
+void aggregator_stream::wait_for_data(int timeout_ms) {
+    std::vector<pollfd> fds;
+    std::vector<size_t> which;
+    fds.push_back({listen_fd, POLLIN, 0});
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i].fd >= 0) {
+            fds.push_back({workers[i].fd, POLLIN, 0});
+            which.push_back(i);
+        }
+    }
+    if (poll(fds.data(), fds.size(), timeout_ms) <= 0) {
+        return;
+    }
+    for (size_t i = 1; i < fds.size(); i++) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+        auto &w = workers[which[i - 1]];
+        if (!receive(w)) {
+            std::cout << "Worker " << which[i - 1] << " disconnected" << std::endl;
+            close(w.fd);
+            w.fd = -1;
+            w.buffer.clear();
+        }
+    }
+    // Last, so the worker list doesn't move while the others are handled
+    if (fds[0].revents & POLLIN) {
+        accept_worker();
+    }
+}
+
+// Read what's there and handle every complete message, false if the worker has gone
+bool aggregator_stream::receive(worker &w) {
+    uint8_t chunk[65536];
+    // Leave the rest in the socket until what's buffered is handled
+    while (w.buffer.size() < sizeof(delta_message_header) + DELTA_MAX_MESSAGE) {
+        auto n = recv(w.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            break;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes_received += n;
+        w.buffer.insert(w.buffer.end(), chunk, chunk + n);
+    }
+
+    size_t position = 0;
+    while (w.buffer.size() - position >= sizeof(delta_message_header)) {
+        delta_message_header header;
+        std::memcpy(&header, w.buffer.data() + position, sizeof(header));
+        if (header.magic != DELTA_MAGIC) {
+            std::cerr << "Worker sent garbage, dropping it" << std::endl;
+            return false;
+        }
+        if (header.length > DELTA_MAX_MESSAGE) {
+            std::cerr << "Worker sent a " << header.length << " byte message, more than the maximum, dropping it" << std::endl;
+            return false;
+        }
+        if (w.buffer.size() - position - sizeof(header) < header.length) {
+            break;
+        }
+        if (!handle_message(w, header.type, w.buffer.data() + position + sizeof(header), header.length)) {
+            std::cerr << "Worker sent a bad message, dropping it" << std::endl;
+            return false;
+        }
+        position += sizeof(header) + header.length;
+    }
+    w.buffer.erase(w.buffer.begin(), w.buffer.begin() + position);
+    return true;
+}
+
+bool aggregator_stream::handle_message(worker &w, uint32_t type, const uint8_t *payload, uint64_t length) {
+    delta_reader reader(payload, length);
+    if (type == DELTA_CATALOG) {
+        auto count = reader.get<uint32_t>();
+        w.targets.assign(count, nullptr);
+        int missing = 0;
+        for (uint32_t i = 0; i < count && reader.ok; i++) {
+            auto folder = reader.get_string();
+            auto name = reader.get_string();
+            auto cells = reader.get<uint32_t>();
+            auto found = histograms.find(folder + "/" + name);
+            // Same name but booked differently, e.g. another WAVEFORM_ADC_BINS
+            if (found == histograms.end() || (uint32_t) found->second->GetNcells() != cells) {
+                missing++;
+                continue;
+            }
+            w.targets[i] = found->second;
+        }
+        if (missing > 0) {
+            std::cerr << missing << " of the worker's histograms don't match any here, are the configs the same?" << std::endl;
+        }
+        return reader.ok;
+    }
+    if (type != DELTA_UPDATE) {
+        return true;
+    }
+
+    reader.get<int32_t>();  // Run number, the aggregator keeps its own
+    auto fpgas = reader.get<uint32_t>();
+    for (uint32_t i = 0; i < fpgas && reader.ok; i++) {
+        auto fpga = reader.get<uint32_t>();
+        auto counts = reader.get<sequence_counts>();
+        // Each FPGA is read by one worker, so its latest numbers are the totals, even across reconnects
+        if (reader.ok && fpga < (uint32_t) configuration::get_instance()->NUM_FPGA) {
+            trackers[fpga].set_counts(counts);
+        }
+    }
+    auto changed = reader.get<uint32_t>();
+    for (uint32_t h = 0; h < changed && reader.ok; h++) {
+        auto index = reader.get<uint32_t>();
+        auto entries = reader.get<double>();
+        auto bins = reader.get<uint32_t>();
+        TH1 *hist = index < w.targets.size() ? w.targets[index] : nullptr;
+        for (uint32_t b = 0; b < bins && reader.ok; b++) {
+            auto bin = reader.get<uint32_t>();
+            auto change = reader.get<double>();
+            if (hist != nullptr && reader.ok) {
+                hist->AddBinContent(bin, change);
+            }
+        }
+        if (hist != nullptr) {
+            hist->SetEntries(hist->GetEntries() + entries);
+        }
+    }
+    return reader.ok;
+}
+
+void aggregator_stream::print_packet_numbers() {
+    int connected = 0;
+    for (auto &w : workers) {
+        if (w.fd >= 0) connected++;
+    }
+    std::cout << "\n" << connected << " workers connected, " << bytes_received / 1024 << " kB received" << std::endl;
+    packet_stream::print_packet_numbers();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "packet_stream.h"
+
+#include <TH1.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Aggregator side of a distributed monitor.  It is an input that never has packets: while the
+// main loop waits for data, it accepts workers and adds the histogram changes they send to the
+// same histograms the worker filled, found by folder and name.  The packet counters shown are
+// the ones last reported by the worker reading each FPGA.
+class aggregator_stream : public packet_stream {
+private:
+    struct worker {
+        int fd;                                 // -1 once it has gone away
+        std::vector<uint8_t> buffer;            // Received but not yet handled
+        std::vector<TH1*> targets;              // [catalog index], nullptr if there's no match here
+    };
+
+    int listen_fd;
+    std::vector<worker> workers;
+    std::map<std::string, TH1*> histograms;     // By folder/name
+    uint64_t bytes_received;
+
+    void accept_worker();
+    bool receive(worker &w);
+    bool handle_message(worker &w, uint32_t type, const uint8_t *payload, uint64_t length);
+
+public:
+    aggregator_stream(const char *address);
+    ~aggregator_stream();
+    int read_packet(uint8_t *buffer) override {return 0;}
+    void wait_for_data(int timeout_ms) override;
+    uint64_t get_backlog() override {return 0;}
+    // Workers can always send more
+    bool finished() override {return false;}
+    void print_packet_numbers() override;
+};
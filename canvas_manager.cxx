@@ -1,4 +1,5 @@
 #include "canvas_manager.h"
+#include "configuration.h"
 
 #include <TCanvas.h>
 #include <TSystem.h>
@@ -40,7 +41,7 @@ void canvas_manager::save_all(int run_number, int time) {
     gSystem->mkdir(Form("monitoring_plots/run_%03d", run_number), kTRUE);
     std::cout << "saving " << canvases.size() << " canvases" << std::endl;
     for (int i = 0; i < canvases.size(); i++) {
-        canvases[i]->SaveAs(Form("monitoring_plots/run_%03d/run_%03d_%s_%d.pdf", run_number, run_number, canvases[i]->GetName(), time));
+        canvases[i]->SaveAs(Form("monitoring_plots/run_%03d/run_%03d_%s_%d%s.pdf", run_number, run_number, canvases[i]->GetName(), time, configuration::get_instance()->output_tag().c_str()));
     }
 }
 
@@ -3,41 +3,90 @@
 #include "configuration.h"
 #include "server.h"
 #include "event_builder.h"
+#include "mapping.h"
 
 #include <TH1.h>
 #include <TH2.h>
 #include <TCanvas.h>
 #include <iostream>
 
-channel_stream::channel_stream(int fpga_id, int asic_id, int channel, TH2 *adc_per_channel, TH2 *tot_per_channel, TH2 *toa_per_channel) {
+channel_stream::channel_stream(int fpga_id, int asic_id, int channel, TH2 *adc_per_channel, TH2 *tot_per_channel, TH2 *toa_per_channel, pedestal_tracker *pedestals, occupancy_tracker *occupancy) {
     this->fpga_id = fpga_id;
     this->asic_id = asic_id;
     this->channel = channel;
+    this->global_channel = geometry::global_channel(fpga_id, asic_id, channel);
+    this->pedestals = pedestals;
+    this->occupancy = occupancy;
     auto config = configuration::get_instance();
+    // Everything here is a count, so the histograms store 32 bit integers rather than doubles.
+    // With over a thousand channels that's most of the monitor's memory.
     packets_attempted = 0;
     packets_complete = 0;
     events = 0;
+    events_kept = 0;
+    events_suppressed = 0;
     current_event = nullptr;
+    recent = nullptr;
+    if (config->WAVEFORM_RING_SIZE > 0) {
+        recent = new waveform_ring(config->WAVEFORM_RING_SIZE, config->MAX_SAMPLES);
+    }
     
 		//adc_spectra = new TH1D(Form("adc_spectra_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Spectra FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_ADC/2, 0, config->MAX_ADC);
-    adc_spectra = new TH1D(Form("adc_spectra_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Spectra FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), 300, 0, 300);
-    tot_spectra = new TH1D(Form("tot_spectra_%d_%d_%d", fpga_id, asic_id, channel), Form("TOT Spectra FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_TOT/2, 0, config->MAX_TOT);
-    toa_spectra = new TH1D(Form("toa_spectra_%d_%d_%d", fpga_id, asic_id, channel), Form("TOA Spectra FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_TOA/2, 0, config->MAX_TOA);
+    adc_spectra = new TH1I(Form("adc_spectra_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Spectra FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), 300, 0, 300);
+    tot_spectra = new TH1I(Form("tot_spectra_%d_%d_%d", fpga_id, asic_id, channel), Form("TOT Spectra FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_TOT/2, 0, config->MAX_TOT);
+    toa_spectra = new TH1I(Form("toa_spectra_%d_%d_%d", fpga_id, asic_id, channel), Form("TOA Spectra FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_TOA/2, 0, config->MAX_TOA);
     adc_spectra->SetTitle("");
     tot_spectra->SetTitle("");
     toa_spectra->SetTitle("");
     
-    adc_waveform = new TH2D(Form("adc_waveform_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Waveform FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_SAMPLES, 0, config->MAX_SAMPLES, 1024, 0, config->MAX_ADC);
+    adc_waveform = new TH2I(Form("adc_waveform_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Waveform FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_SAMPLES, 0, config->MAX_SAMPLES, config->WAVEFORM_ADC_BINS, 0, config->MAX_ADC);
     adc_waveform->SetTitle("");
 
-    adc_max = new TH1D(Form("adc_max_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Max FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), 1024, 0, config->MAX_ADC);
+    adc_max = new TH1I(Form("adc_max_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Max FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), 1024, 0, config->MAX_ADC);
+    adc_amplitude = new TH1I(Form("adc_amplitude_%d_%d_%d", fpga_id, asic_id, channel), Form("ADC Amplitude over Running Pedestal FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), 1024, 0, config->MAX_ADC);
+    peak_sample = new TH1I(Form("peak_sample_%d_%d_%d", fpga_id, asic_id, channel), Form("Peak Sample FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), config->MAX_SAMPLES, 0, config->MAX_SAMPLES);
+    peak_time = new TH1I(Form("peak_time_%d_%d_%d", fpga_id, asic_id, channel), Form("Fitted Peak Time FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), 10 * config->MAX_SAMPLES, 0, config->MAX_SAMPLES);
+    // Pedestal only readouts scatter around 0, so the range goes negative too, bins stay 4 ADC wide
+    integral = new TH1I(Form("integral_%d_%d_%d", fpga_id, asic_id, channel), Form("Pulse Integral FPGA %d ASIC %d Channel %d", fpga_id, asic_id, channel), 1280, -config->MAX_ADC, 4 * config->MAX_ADC);
+
+    auto s = server::get_instance();
+    s->register_object(Form("/QA Plots/Spectra/individual/fpga%d/adc", fpga_id), adc_spectra);
+    s->register_object(Form("/QA Plots/Spectra/individual/fpga%d/tot", fpga_id), tot_spectra);
+    s->register_object(Form("/QA Plots/Spectra/individual/fpga%d/toa", fpga_id), toa_spectra);
+    s->register_object(Form("/QA Plots/Waveform/fpga%d/adc_waveform", fpga_id), adc_waveform);
+    s->register_object(Form("/QA Plots/Waveform/fpga%d/adc_max", fpga_id), adc_max);
+    s->register_object(Form("/QA Plots/Waveform/fpga%d/adc_amplitude", fpga_id), adc_amplitude);
+    s->register_object(Form("/QA Plots/Waveform/fpga%d/peak_sample", fpga_id), peak_sample);
+    s->register_object(Form("/QA Plots/Waveform/fpga%d/peak_time", fpga_id), peak_time);
+    s->register_object(Form("/QA Plots/Waveform/fpga%d/integral", fpga_id), integral);
 
-    auto s = server::get_instance()->get_server();
-    s->Register(Form("/QA Plots/Spectra/individual/fpga%d/adc", fpga_id), adc_spectra);
-    s->Register(Form("/QA Plots/Spectra/individual/fpga%d/tot", fpga_id), tot_spectra);
-    s->Register(Form("/QA Plots/Spectra/individual/fpga%d/toa", fpga_id), toa_spectra);
-    s->Register(Form("/QA Plots/Waveform/fpga%d/adc_waveform", fpga_id), adc_waveform);
-    s->Register(Form("/QA Plots/Waveform/fpga%d/adc_max", fpga_id), adc_max);
+    rolling_adc = nullptr;
+    rolling_tot = nullptr;
+    rolling_toa = nullptr;
+    rolling_waveform = nullptr;
+    adc_window = nullptr;
+    tot_window = nullptr;
+    toa_window = nullptr;
+    waveform_window = nullptr;
+    int windows = config->ROLLING_WINDOWS.size();
+    if (windows > 0) {
+        // Coarser binning than the cumulative histograms to keep the slices small
+        int slices = config->ROLLING_SLICES;
+        rolling_adc = new rolling_histogram(300, 300, 1, 1, windows, slices);
+        rolling_tot = new rolling_histogram(config->MAX_TOT / 16, config->MAX_TOT, 1, 1, windows, slices);
+        rolling_toa = new rolling_histogram(config->MAX_TOA / 8, config->MAX_TOA, 1, 1, windows, slices);
+        adc_window = new TH1I(Form("adc_window_%d_%d_%d", fpga_id, asic_id, channel), "", 300, 0, 300);
+        tot_window = new TH1I(Form("tot_window_%d_%d_%d", fpga_id, asic_id, channel), "", config->MAX_TOT / 16, 0, config->MAX_TOT);
+        toa_window = new TH1I(Form("toa_window_%d_%d_%d", fpga_id, asic_id, channel), "", config->MAX_TOA / 8, 0, config->MAX_TOA);
+        s->register_object(Form("/QA Plots/Rolling/individual/fpga%d/adc", fpga_id), adc_window);
+        s->register_object(Form("/QA Plots/Rolling/individual/fpga%d/tot", fpga_id), tot_window);
+        s->register_object(Form("/QA Plots/Rolling/individual/fpga%d/toa", fpga_id), toa_window);
+        if (config->ROLLING_WAVEFORMS) {
+            rolling_waveform = new rolling_histogram(config->MAX_SAMPLES, config->MAX_SAMPLES, config->MAX_ADC / 16, config->MAX_ADC, windows, slices);
+            waveform_window = new TH2I(Form("waveform_window_%d_%d_%d", fpga_id, asic_id, channel), "", config->MAX_SAMPLES, 0, config->MAX_SAMPLES, config->MAX_ADC / 16, 0, config->MAX_ADC);
+            s->register_object(Form("/QA Plots/Rolling/individual/fpga%d/adc_waveform", fpga_id), waveform_window);
+        }
+    }
 
     this->adc_per_channel = adc_per_channel;
     this->tot_per_channel = tot_per_channel;
@@ -50,33 +99,77 @@ channel_stream::~channel_stream() {
     }
 }
 
-void channel_stream::construct_event(uint32_t timestamp, uint32_t adc) {
+void channel_stream::construct_event(uint32_t timestamp, uint32_t adc, uint32_t tot, uint32_t toa) {
     if (current_event == nullptr) {
         current_event = new single_channel_event(fpga_id, channel, asic_id, configuration::get_instance()->MAX_SAMPLES);
     }
-    auto success = current_event->add_sample(timestamp, adc);
+    auto success = current_event->add_sample(timestamp, adc, tot, toa);
     if (!success) {
         delete current_event;
         current_event = nullptr;
-        construct_event(timestamp, adc);  // is this a bad idea?  probably
+        construct_event(timestamp, adc, tot, toa);  // is this a bad idea?  probably
     }
     if (current_event->is_complete()) {
-        current_event->fill_waveform(adc_waveform, adc_max);
-        current_event->write_to_tree();
+        pedestals->update(global_channel, current_event->get_samples(), current_event->get_found_samples());
+        if (recent != nullptr) {
+            recent->push(current_event->get_timestamps(), current_event->get_samples(), current_event->get_found_samples(), current_event->get_max_tot(), current_event->get_max_toa());
+        }
+        if (passes_zero_suppression()) {
+            // Amplitude, timing and the tree entry are filled once the feature kernel has run, see fill_features
+            current_event->fill_waveform(adc_waveform, adc_max, rolling_waveform);
+            events_kept++;
+        } else {
+            current_event->set_kept(false);
+            events_suppressed++;
+        }
+        // Suppressed channels still go to the event builder, it needs every channel to complete an event
         completed_events.push_back(current_event);
         current_event = nullptr;
         events++;
     }
 }
 
+//********************************************************************************************
+// Zero suppression, only channels with a signal get waveforms and tree entries
+//********************************************************************************************
+bool channel_stream::passes_zero_suppression() {
+    auto config = configuration::get_instance();
+    if (config->ZS_THRESHOLD <= 0) {
+        return true;
+    }
+    // Wait until we have a decent pedestal before throwing anything away
+    if (pedestals->get_count(global_channel) < 100) {
+        return true;
+    }
+    if (config->ZS_KEEP_TOT_TOA && (current_event->get_max_tot() > 0 || current_event->get_max_toa() > 0)) {
+        return true;
+    }
+    return current_event->get_max_adc() > pedestals->get_pedestal(global_channel) + config->ZS_THRESHOLD;
+}
+
+// Called by the monitor after pulse_features has processed a kept event
+void channel_stream::fill_features(single_channel_event *e) {
+    adc_amplitude->Fill(e->get_amplitude());
+    peak_sample->Fill(e->get_peak_sample());
+    peak_time->Fill(e->get_peak_time());
+    integral->Fill(e->get_integral());
+    e->write_to_tree();
+}
+
 void channel_stream::fill_readouts(uint32_t adc, uint32_t tot, uint32_t toa) {
     adc_spectra->Fill(adc);
     tot_spectra->Fill(tot);
     toa_spectra->Fill(toa);
+    if (rolling_adc != nullptr) {
+        rolling_adc->fill(adc);
+        rolling_tot->fill(tot);
+        rolling_toa->fill(toa);
+    }
 
     adc_per_channel->Fill(72 * asic_id + channel, adc);
     tot_per_channel->Fill(72 * asic_id + channel, tot);
     toa_per_channel->Fill(72 * asic_id + channel, toa);
+    occupancy->fill(global_channel, adc, tot);
 }
 
 void channel_stream::reset() {
@@ -84,4 +177,63 @@ void channel_stream::reset() {
     tot_spectra->Reset("ICESM");
     toa_spectra->Reset("ICESM");
     adc_waveform->Reset("ICESM");
+    adc_amplitude->Reset("ICESM");
+    peak_sample->Reset("ICESM");
+    peak_time->Reset("ICESM");
+    integral->Reset("ICESM");
+    if (recent != nullptr) {
+        recent->reset();
+    }
+    if (rolling_adc != nullptr) {
+        rolling_adc->reset();
+        rolling_tot->reset();
+        rolling_toa->reset();
+        if (rolling_waveform != nullptr) {
+            rolling_waveform->reset();
+        }
+    }
+}
+
+void channel_stream::start_run() {
+    delete current_event;
+    current_event = nullptr;
+    for (auto e : completed_events) {
+        delete e;
+    }
+    completed_events.clear();
+    packets_attempted = 0;
+    packets_complete = 0;
+    events = 0;
+    events_kept = 0;
+    events_suppressed = 0;
+    reset();
+}
+
+void channel_stream::rotate_window(int window) {
+    if (rolling_adc == nullptr) {
+        return;
+    }
+    rolling_adc->rotate(window);
+    rolling_tot->rotate(window);
+    rolling_toa->rotate(window);
+    if (rolling_waveform != nullptr) {
+        rolling_waveform->rotate(window);
+    }
+}
+
+// Refresh the displayed window histograms from the selected window
+void channel_stream::update_window(int window, const char *title) {
+    if (rolling_adc == nullptr) {
+        return;
+    }
+    rolling_adc->project(window, adc_window);
+    rolling_tot->project(window, tot_window);
+    rolling_toa->project(window, toa_window);
+    adc_window->SetTitle(title);
+    tot_window->SetTitle(title);
+    toa_window->SetTitle(title);
+    if (rolling_waveform != nullptr) {
+        rolling_waveform->project(window, waveform_window);
+        waveform_window->SetTitle(title);
+    }
 }
\ No newline at end of file
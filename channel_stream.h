@@ -1,6 +1,10 @@
 #pragma once
 
 #include "event_builder.h"
+#include "rolling_histogram.h"
+#include "pedestal_tracker.h"
+#include "occupancy_tracker.h"
+#include "waveform_ring.h"
 
 #include <cstdint>
 #include <list>
@@ -15,9 +19,12 @@ private:
     int fpga_id;
     int asic_id;
     int channel;
+    int global_channel;
     long int packets_attempted;
     long int packets_complete;
     long int events;
+    long int events_kept;
+    long int events_suppressed;
     uint32_t last_heartbeat_seconds;
     uint32_t last_heartbeat_milliseconds;
 
@@ -25,10 +32,9 @@ private:
 
     TCanvas *c;
 
-    TH2D *adc_samples;
-    TH1D *adc_spectra;
-    TH1D *tot_spectra;
-    TH1D *toa_spectra;
+    TH1 *adc_spectra;
+    TH1 *tot_spectra;
+    TH1 *toa_spectra;
 
     TH2 *adc_per_channel;
     TH2 *tot_per_channel;
@@ -36,21 +42,52 @@ private:
 
     TH2 *adc_waveform;
     TH1 *adc_max;
+    TH1 *adc_amplitude;
+    TH1 *peak_sample;
+    TH1 *peak_time;
+    TH1 *integral;
+
+    pedestal_tracker *pedestals;
+    occupancy_tracker *occupancy;
+    waveform_ring *recent;  // nullptr if disabled
+
+    // Sliding time window copies, nullptr if disabled
+    rolling_histogram *rolling_adc;
+    rolling_histogram *rolling_tot;
+    rolling_histogram *rolling_toa;
+    rolling_histogram *rolling_waveform;
+    TH1 *adc_window;
+    TH1 *tot_window;
+    TH1 *toa_window;
+    TH2 *waveform_window;
 
     std::list<single_channel_event*> completed_events;
 
+    bool passes_zero_suppression();
+
 public:
-    channel_stream(int fpga_id, int asic_id, int channel, TH2 *adc_per_channel, TH2 *tot_per_channel, TH2 *toa_per_channel);
+    channel_stream(int fpga_id, int asic_id, int channel, TH2 *adc_per_channel, TH2 *tot_per_channel, TH2 *toa_per_channel, pedestal_tracker *pedestals, occupancy_tracker *occupancy);
     ~channel_stream();
-    void construct_event(uint32_t timestamp, uint32_t adc);
+    void construct_event(uint32_t timestamp, uint32_t adc, uint32_t tot, uint32_t toa);
     void fill_readouts(uint32_t adc, uint32_t tot, uint32_t toa);
+    void fill_features(single_channel_event *e);
+    float get_pedestal() {return pedestals->get_pedestal(global_channel);}
+    waveform_ring *get_recent() {return recent;}
     void draw_adc() {adc_spectra->Draw();}
     void draw_tot() {tot_spectra->Draw();}
     void draw_toa() {toa_spectra->Draw();}
     void draw_waveform() {adc_waveform->Draw("col");}
     void draw_max() {adc_max->Draw();}
+    void draw_amplitude() {adc_amplitude->Draw();}
+    void draw_adc_window() {adc_window->Draw();}
+    void draw_waveform_window() {waveform_window->Draw("col");}
+    void rotate_window(int window);
+    void update_window(int window, const char *title);
     int test = 42;
 
+    long int get_events_kept() {return events_kept;}
+    long int get_events_suppressed() {return events_suppressed;}
+
     bool has_events() {return completed_events.size() > 0;}
     int completed_event_size() {return completed_events.size();}
     single_channel_event *get_event() {
@@ -59,6 +96,8 @@ public:
         return e;
     }
     void reset();
+    // Forget everything from the previous run, including half built events
+    void start_run();
 };
 
 typedef std::vector<std::vector<std::vector<channel_stream*>>> channel_stream_vector;
@@ -0,0 +1,123 @@
+#include "clock_drift.h"
+
+#include "canvas_manager.h"
+#include "server.h"
+
+#include <TROOT.h>
+#include <TCanvas.h>
+#include <TGraph.h>
+#include <TAxis.h>
+#include <TDatime.h>
+
+#include <cmath>
+#include <iostream>
+
+// Weight of older matches drops by this much per match, about the last thousand count
+static const double drift_decay = 0.999;
+// Matches before the rate is trusted, and before outliers are rejected
+static const uint64_t drift_min_matches = 16;
+// Residuals beyond this many sigma (or 1 tick, whichever is larger) are rejected
+static const double drift_max_sigma = 4;
+
+clock_drift::clock_drift(int num_fpga, int debug) {
+    this->num_fpga = num_fpga;
+    this->debug = debug;
+    sxx = std::vector<double>(num_fpga, 0);
+    sxy = std::vector<double>(num_fpga, 0);
+    residual_var = std::vector<double>(num_fpga, 0);
+    matches = std::vector<uint64_t>(num_fpga, 0);
+    rejected = std::vector<uint64_t>(num_fpga, 0);
+    offset = std::vector<double>(num_fpga, 0);
+
+    auto canvases = canvas_manager::get_instance();
+    auto s = server::get_instance();
+    auto canvas_id = canvases.new_canvas("Clock_Drift", "Clock Drift", 1200, 800);
+    auto c = canvases.get_canvas(canvas_id);
+    s->register_object("/QA Plots/DAQ Performance", c);
+    c->Divide(1, 2);
+    int colors[4] = {kBlue, kRed, kGreen + 2, kOrange};
+    for (int i = 0; i < num_fpga; i++) {
+        auto offset_graph = new TGraph();
+        offset_graph->SetName(Form("fpga_%i_clock_offset", i));
+        gROOT->Add(offset_graph);
+        offset_graph->SetTitle("Clock Offset from FPGA 0 Since First Match");
+        offset_graph->GetXaxis()->SetTitle("Time");
+        offset_graph->GetXaxis()->SetTimeDisplay(1);
+        offset_graph->GetXaxis()->SetTimeFormat("%H:%M:%S");
+        offset_graph->GetYaxis()->SetTitle("Offset (ticks)");
+        offset_graph->SetLineColor(colors[i % 4]);
+        offset_graph->SetLineWidth(2);
+        c->cd(1);
+        offset_graph->Draw(i == 0 ? "AL" : "L");
+        offset_graphs.push_back(offset_graph);
+        offset_series.push_back(new timeseries(offset_graph));
+
+        auto drift_graph = new TGraph();
+        drift_graph->SetName(Form("fpga_%i_clock_drift", i));
+        gROOT->Add(drift_graph);
+        drift_graph->SetTitle("Clock Rate Relative to FPGA 0");
+        drift_graph->GetXaxis()->SetTitle("Time");
+        drift_graph->GetXaxis()->SetTimeDisplay(1);
+        drift_graph->GetXaxis()->SetTimeFormat("%H:%M:%S");
+        drift_graph->GetYaxis()->SetTitle("Drift (ppm)");
+        drift_graph->SetLineColor(colors[i % 4]);
+        drift_graph->SetLineWidth(2);
+        c->cd(2);
+        drift_graph->Draw(i == 0 ? "AL" : "L");
+        drift_graphs.push_back(drift_graph);
+        drift_series.push_back(new timeseries(drift_graph));
+    }
+}
+
+clock_drift::~clock_drift() {
+    for (int i = 0; i < num_fpga; i++) {
+        delete offset_series[i];
+        delete drift_series[i];
+    }
+}
+
+double clock_drift::get_rate(int fpga) {
+    if (fpga == 0 || matches[fpga] < drift_min_matches || sxx[fpga] <= 0) {
+        return 1;
+    }
+    return sxy[fpga] / sxx[fpga];
+}
+
+void clock_drift::add_match(const std::vector<uint32_t> &intervals) {
+    double x = intervals[0];
+    if (x <= 0) {
+        return;
+    }
+    for (int i = 1; i < num_fpga; i++) {
+        double y = intervals[i];
+        offset[i] += y - x;
+        if (matches[i] >= drift_min_matches) {
+            double residual = y - get_rate(i) * x;
+            double limit = std::max(drift_max_sigma * std::sqrt(residual_var[i]), 1.0);
+            if (std::fabs(residual) > limit) {
+                rejected[i]++;
+                continue;
+            }
+            residual_var[i] = drift_decay * residual_var[i] + (1 - drift_decay) * residual * residual;
+        }
+        sxx[i] = drift_decay * sxx[i] + x * x;
+        sxy[i] = drift_decay * sxy[i] + x * y;
+        matches[i]++;
+        if (matches[i] == drift_min_matches) {
+            // Seed the spread from what we have so far, rather than starting at zero
+            double rate = get_rate(i);
+            residual_var[i] = std::pow(y - rate * x, 2) + 1;
+        }
+    }
+}
+
+void clock_drift::update_graphs() {
+    auto time = TDatime();
+    for (int i = 0; i < num_fpga; i++) {
+        offset_series[i]->add(time.Convert(), offset[i]);
+        drift_series[i]->add(time.Convert(), (get_rate(i) - 1) * 1e6);
+        if (i > 0 && debug > 0) {
+            std::cout << "FPGA " << i << " clock drift " << (get_rate(i) - 1) * 1e6 << " ppm, offset " << offset[i] << " ticks, " << rejected[i] << " matches rejected from the fit." << std::endl;
+        }
+    }
+}
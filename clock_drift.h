@@ -0,0 +1,42 @@
+#pragma once
+
+#include "timeseries.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <TGraph.h>
+
+// Running estimate of each FPGA's clock against FPGA 0, from the intervals between
+// consecutive matched events.  The rate (ticks per FPGA 0 tick) is an exponentially weighted
+// least squares slope through the origin, and pairs whose residual is far outside the
+// running spread are left out of it, so one bad match can't drag the estimate.  The
+// aligner divides each FPGA's interval by its rate before comparing them.
+class clock_drift {
+private:
+    int num_fpga;
+    int debug;
+    std::vector<double> sxx;
+    std::vector<double> sxy;
+    std::vector<double> residual_var;
+    std::vector<uint64_t> matches;
+    std::vector<uint64_t> rejected;
+    std::vector<double> offset;     // Accumulated ticks ahead of FPGA 0 since the first match
+
+    std::vector<TGraph*> offset_graphs;
+    std::vector<TGraph*> drift_graphs;
+    std::vector<timeseries*> offset_series;
+    std::vector<timeseries*> drift_series;
+
+public:
+    clock_drift(int num_fpga, int debug = 0);
+    ~clock_drift();
+
+    // Ticks since the previous match on each FPGA
+    void add_match(const std::vector<uint32_t> &intervals);
+    // FPGA 0 ticks for an interval measured on this FPGA
+    double to_reference(int fpga, uint32_t interval) {return interval / get_rate(fpga);}
+    double get_rate(int fpga);
+    uint64_t get_rejected(int fpga) {return rejected[fpga];}
+    void update_graphs();
+};
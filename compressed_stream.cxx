@@ -0,0 +1,146 @@
+#include "compressed_stream.h"
+
+#include "configuration.h"
+#include "run_header.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+// Packets per block, and blocks in flight between the two threads
+static const size_t block_packets = 4096;
+static const int num_blocks = 4;
+
+//********************************************************************************************
+// Open the run and start decompressing
+//********************************************************************************************
+compressed_stream::compressed_stream(const std::string &fname) {
+    std::cout << "Attempting to open compressed file " << fname << std::endl;
+    run_header header;
+    if (!read_run_header(fname, header) || !header.complete) {
+        std::cerr << "Could not find the end of the header in " << fname << std::endl;
+        throw std::runtime_error("Error opening file");
+    }
+    data_start = header.data_start;
+    source = new decompressor(fname);
+    if (!source->good()) {
+        delete source;
+        throw std::runtime_error("Error opening file");
+    }
+    block_size = block_packets * configuration::get_instance()->PACKET_SIZE;
+    for (int i = 0; i < num_blocks; i++) {
+        blocks.push_back(std::vector<char>(block_size));
+        free_blocks.push_back(i);
+    }
+    current_block = -1;
+    current_size = 0;
+    current_offset = 0;
+    source_done = false;
+    stopping = false;
+    worker = std::thread(&compressed_stream::decompress, this);
+}
+
+compressed_stream::~compressed_stream() {
+    stopping = true;
+    block_freed.notify_all();
+    worker.join();
+    print_packet_numbers();
+    delete source;
+}
+
+
+//********************************************************************************************
+// Decompression thread, fills free blocks until the file ends
+//********************************************************************************************
+void compressed_stream::decompress() {
+    // Skip the header, it was already parsed
+    std::vector<char> header(data_start);
+    bool good = source->read(header.data(), header.size()) == header.size();
+    while (good && !stopping) {
+        int block;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            block_freed.wait(guard, [this] {return stopping || !free_blocks.empty();});
+            if (stopping) {
+                break;
+            }
+            block = free_blocks.front();
+            free_blocks.pop_front();
+        }
+        size_t size = source->read(blocks[block].data(), block_size);
+        // A partial packet at the end of the file is dropped, like file_stream does
+        size -= size % configuration::get_instance()->PACKET_SIZE;
+        std::lock_guard<std::mutex> guard(lock);
+        if (size > 0) {
+            full_blocks.push_back({block, size});
+        } else {
+            free_blocks.push_back(block);
+        }
+        good = size == block_size;
+        block_filled.notify_all();
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    source_done = true;
+    block_filled.notify_all();
+}
+
+
+//********************************************************************************************
+// Reading packets
+//********************************************************************************************
+// Hand the used block back and take the next one, waiting up to timeout_ms for it
+bool compressed_stream::next_block(int timeout_ms) {
+    std::unique_lock<std::mutex> guard(lock);
+    if (current_block >= 0) {
+        free_blocks.push_back(current_block);
+        current_block = -1;
+        block_freed.notify_all();
+    }
+    block_filled.wait_for(guard, std::chrono::milliseconds(timeout_ms), [this] {return source_done || !full_blocks.empty();});
+    if (full_blocks.empty()) {
+        return false;
+    }
+    current_block = full_blocks.front().first;
+    current_size = full_blocks.front().second;
+    current_offset = 0;
+    full_blocks.pop_front();
+    return true;
+}
+
+int compressed_stream::read_packet(uint8_t *buffer) {
+    auto packet_size = configuration::get_instance()->PACKET_SIZE;
+    if ((current_block < 0 || current_offset >= current_size) && !next_block(0)) {
+        return 0;
+    }
+    memcpy(buffer, blocks[current_block].data() + current_offset, packet_size);
+    current_offset += packet_size;
+    return count_packet(buffer);
+}
+
+void compressed_stream::wait_for_data(int timeout_ms) {
+    if (current_block >= 0 && current_offset < current_size) {
+        return;
+    }
+    if (finished()) {
+        // Nothing more will come, don't let the caller spin
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return;
+    }
+    next_block(timeout_ms);
+}
+
+// Decompressed and waiting to be read
+uint64_t compressed_stream::get_backlog() {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t backlog = current_block >= 0 ? current_size - current_offset : 0;
+    for (auto &block : full_blocks) {
+        backlog += block.second;
+    }
+    return backlog;
+}
+
+bool compressed_stream::finished() {
+    std::lock_guard<std::mutex> guard(lock);
+    return source_done && full_blocks.empty() && (current_block < 0 || current_offset >= current_size);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "packet_stream.h"
+#include "decompressor.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reads an archived, compressed run without unpacking it to disk first.  A second thread
+// decompresses the run into a few large blocks of whole packets while the monitor decodes
+// the previous ones, so decompression and decoding run side by side.  Archived runs are
+// complete, so there is no following, seeking or checkpointing.
+class compressed_stream : public packet_stream {
+private:
+    decompressor *source;
+    uint64_t data_start;
+    size_t block_size;                      // Bytes, a whole number of packets
+    std::vector<std::vector<char>> blocks;
+    std::deque<int> free_blocks;
+    std::deque<std::pair<int, size_t>> full_blocks;     // Block and bytes in it
+    std::mutex lock;
+    std::condition_variable block_freed;
+    std::condition_variable block_filled;
+    std::atomic<bool> stopping;
+    bool source_done;                       // Guarded by lock
+    std::thread worker;
+
+    int current_block;                      // -1 if none
+    size_t current_size;
+    size_t current_offset;
+
+    void decompress();
+    bool next_block(int timeout_ms);
+
+public:
+    compressed_stream(const std::string &fname);
+    ~compressed_stream();
+    int read_packet(uint8_t *buffer) override;
+    void wait_for_data(int timeout_ms) override;
+    uint64_t get_backlog() override;
+    // Everything has been decompressed and read
+    bool finished() override;
+};
@@ -1,5 +1,8 @@
 #include "configuration.h"
 
+#include "mapping.h"
+#include "run_header.h"
+
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -31,6 +34,8 @@ void load_configs(std::string config_file, int run, int debug) {
                     config->NUM_LINES = std::stoi(value);
                 } else if (key == "MAX_SAMPLES") {
                     config->MAX_SAMPLES = std::stoi(value);
+                } else if (key == "WAVEFORM_ADC_BINS") {
+                    config->WAVEFORM_ADC_BINS = std::stoi(value);
                 } else if (key == "MACHINE_GUN_MAX_TIME") {
                     config->MACHINE_GUN_MAX_TIME = std::stoi(value);
                 } else if (key == "PACKET_SIZE") {
@@ -39,6 +44,75 @@ void load_configs(std::string config_file, int run, int debug) {
                     config->DETECTOR_ID = std::stoi(value);
                 } else if (key == "SETUP_ID") {
                     config->SETUP_ID = std::stoi(value);
+                } else if (key == "LOAD_SHED_BACKLOG_MB") {
+                    config->LOAD_SHED_BACKLOG_MB = std::stoi(value);
+                } else if (key == "LOAD_SHED_MAX_PRESCALE") {
+                    config->LOAD_SHED_MAX_PRESCALE = std::stoi(value);
+                } else if (key == "LOAD_SHED_BURST") {
+                    config->LOAD_SHED_BURST = std::stoi(value);
+                } else if (key == "CHECKPOINT_INTERVAL") {
+                    config->CHECKPOINT_INTERVAL = std::stoi(value);
+                } else if (key == "ROLLING_WINDOWS") {
+                    // Comma separated list of minutes
+                    config->ROLLING_WINDOWS.clear();
+                    std::size_t start = 0;
+                    while (start < value.size()) {
+                        std::size_t comma = value.find(',', start);
+                        if (comma == std::string::npos) comma = value.size();
+                        if (comma > start) config->ROLLING_WINDOWS.push_back(std::stoi(value.substr(start, comma - start)));
+                        start = comma + 1;
+                    }
+                } else if (key == "ROLLING_SLICES") {
+                    config->ROLLING_SLICES = std::stoi(value);
+                } else if (key == "ROLLING_WAVEFORMS") {
+                    config->ROLLING_WAVEFORMS = std::stoi(value);
+                } else if (key == "ZS_THRESHOLD") {
+                    config->ZS_THRESHOLD = std::stoi(value);
+                } else if (key == "ZS_KEEP_TOT_TOA") {
+                    config->ZS_KEEP_TOT_TOA = std::stoi(value);
+                } else if (key == "OCCUPANCY_THRESHOLD") {
+                    config->OCCUPANCY_THRESHOLD = std::stoi(value);
+                } else if (key == "OCCUPANCY_MIN_READOUTS") {
+                    config->OCCUPANCY_MIN_READOUTS = std::stoi(value);
+                } else if (key == "OCCUPANCY_HOT_FACTOR") {
+                    config->OCCUPANCY_HOT_FACTOR = std::stoi(value);
+                } else if (key == "OCCUPANCY_DEAD_PERCENT") {
+                    config->OCCUPANCY_DEAD_PERCENT = std::stoi(value);
+                } else if (key == "WAVEFORM_RING_SIZE") {
+                    config->WAVEFORM_RING_SIZE = std::stoi(value);
+                } else if (key == "EVENT_DISPLAY_INTERVAL") {
+                    config->EVENT_DISPLAY_INTERVAL = std::stoi(value);
+                } else if (key == "RECO_CHANNEL_THRESHOLD") {
+                    config->RECO_CHANNEL_THRESHOLD = std::stoi(value);
+                } else if (key == "FILE_VERSION_MAJOR") {
+                    // Only needed when there's no run file to read it from, the run header wins
+                    config->FILE_VERSION_MAJOR = std::stoi(value);
+                } else if (key == "FILE_VERSION_MINOR") {
+                    config->FILE_VERSION_MINOR = std::stoi(value);
+                } else if (key == "UDP_PORT") {
+                    config->UDP_PORT = std::stoi(value);
+                } else if (key == "UDP_BIND_ADDRESS") {
+                    config->UDP_BIND_ADDRESS = value;
+                } else if (key == "UDP_RCVBUF_MB") {
+                    config->UDP_RCVBUF_MB = std::stoi(value);
+                } else if (key == "UDP_BATCH") {
+                    config->UDP_BATCH = std::stoi(value);
+                } else if (key == "SHM_EXPORT") {
+                    config->SHM_EXPORT = value;
+                } else if (key == "WORKER_FPGAS") {
+                    // Comma separated list of FPGAs
+                    config->WORKER_FPGAS.clear();
+                    std::size_t start = 0;
+                    while (start < value.size()) {
+                        std::size_t comma = value.find(',', start);
+                        if (comma == std::string::npos) comma = value.size();
+                        if (comma > start) config->WORKER_FPGAS.push_back(std::stoi(value.substr(start, comma - start)));
+                        start = comma + 1;
+                    }
+                } else if (key == "AGGREGATOR") {
+                    config->AGGREGATOR = value;
+                } else if (key == "AGGREGATOR_LISTEN") {
+                    config->AGGREGATOR_LISTEN = value;
                 }
                 else {
                     std::cerr << "Unknown key: " << key << std::endl;
@@ -63,87 +137,70 @@ void load_configs(std::string config_file, int run, int debug) {
         if (!dir.empty() && dir.back() != '/' && dir.back() != '\\') dir.push_back('/');
         run_file = dir + run_file;
     }
+    run_file = find_run_file(run_file);
 
-    std::ifstream runfile(run_file);
-    bool is_jumbo = false;
-    if (runfile.is_open()) {
-        if (debug == 2) std::cout << "opened run file: " << run_file << std::endl;
-        std::string line;
-        // Skip two lines
-        std::getline(runfile, line);
-        std::getline(runfile, line);
-        while (std::getline(runfile, line)) {
-            if (debug == 2)  std::cout << "processing line: " << line << std::endl;
-            if (line == "##################################################") break;
-            // Look for the file version
-            std::string key, value;
-            std::size_t delimiter_pos = line.find(':');
-            if (delimiter_pos != std::string::npos) {
-                key = line.substr(0, delimiter_pos);
-                value = line.substr(delimiter_pos + 1);
-                // Do something with the key-value pair
-                if (key == "# File Version") {
-                    std::cout << "Run file version: " << value << std::endl;
-                    std::size_t dot_pos = value.find('.');
-                    if (dot_pos != std::string::npos) {
-                        config->FILE_VERSION_MAJOR = std::stoi(value.substr(0, dot_pos));
-                        config->FILE_VERSION_MINOR = std::stoi(value.substr(dot_pos + 1));
-                    }
-                }
-                if (key == "# Number of KCUs") {
-                    config->NUM_FPGA = std::stoi(value);
-                    std::cout << "Resetting NUM_FPGA to " << config->NUM_FPGA << std::endl;
-                }
-                if (key == "# Number of ASICs") {
-                    config->NUM_ASIC = std::stoi(value);
-                    std::cout << "Resetting NUM_ASIC to " << config->NUM_ASIC << std::endl;
-                }                      
-                if (key == "# Generator Setting data_coll_enable") {
-                    int dataEnable = std::stoi(value);
-                    int a = 1;
-                    int minEnable = int(a << (config->NUM_ASIC-1));
-                    int maxEnable = int(a << (config->NUM_ASIC));
-                    std::cout << "Data enable check-----> " << dataEnable << "\t" << minEnable<< "\t" << maxEnable<< "\t"<< config->NUM_ASIC << std::endl;
-                    
-                    if (dataEnable < minEnable ){
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                      std::cerr << "==============================================================" << std::endl;
-                      std::cerr << "ATTENTION:: You are enabling less ASICS than you think !!!!" << std::endl;
-                      std::cerr << "-----> " << dataEnable << "\t" << minEnable<< "\t"<< config->NUM_ASIC << std::endl;
-                      std::cerr << "==============================================================" << std::endl;
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                    }
-                    if (dataEnable > maxEnable ){
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                      std::cerr << "==============================================================" << std::endl;
-                      std::cerr << "ATTENTION:: You are enabling more ASICS than you should !!!!" << std::endl;
-                      std::cerr << "-----> " << dataEnable << "\t" << maxEnable << "\t"<< config->NUM_ASIC << std::endl;
-                      std::cerr << "==============================================================" << std::endl;
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                      std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
-                    }
-                }
-                
-                if (key == "# Generator Setting machine_gun") {
-                    config->MAX_SAMPLES = std::stoi(value);
-                    std::cout << "Resetting MAX_SAMPLES to " << config->MAX_SAMPLES << std::endl;
-                }
-                if (key == "# Generator Setting jumbo_enable") {
-                    // 0 if off, 1 if on
-                    is_jumbo = std::stoi(value);
-                    if (is_jumbo) {
-                        config->PACKET_SIZE = 8846;
-                    } else {
-                        config->PACKET_SIZE = 1358;
-                    }
-                    std::cout << "Setting PACKET_SIZE to " << config->PACKET_SIZE << std::endl;
-                }
+    run_header header;
+    if (read_run_header(run_file, header)) {
+        if (debug == 2) {
+            std::cout << "opened run file: " << run_file << std::endl;
+            for (auto &entry : header.entries) {
+                std::cout << "header entry: " << entry.first << ": " << entry.second << std::endl;
+            }
+        }
+        if (header.file_version_major >= 0) {
+            std::cout << "Run file version: " << header.file_version_major << "." << header.file_version_minor << std::endl;
+            config->FILE_VERSION_MAJOR = header.file_version_major;
+            config->FILE_VERSION_MINOR = header.file_version_minor;
+        }
+        if (header.num_kcu >= 0) {
+            config->NUM_FPGA = header.num_kcu;
+            std::cout << "Resetting NUM_FPGA to " << config->NUM_FPGA << std::endl;
+        }
+        if (header.num_asic >= 0) {
+            config->NUM_ASIC = header.num_asic;
+            std::cout << "Resetting NUM_ASIC to " << config->NUM_ASIC << std::endl;
+        }
+        if (header.data_coll_enable >= 0) {
+            int dataEnable = header.data_coll_enable;
+            int a = 1;
+            int minEnable = int(a << (config->NUM_ASIC-1));
+            int maxEnable = int(a << (config->NUM_ASIC));
+            std::cout << "Data enable check-----> " << dataEnable << "\t" << minEnable<< "\t" << maxEnable<< "\t"<< config->NUM_ASIC << std::endl;
+            
+            if (dataEnable < minEnable ){
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+              std::cerr << "==============================================================" << std::endl;
+              std::cerr << "ATTENTION:: You are enabling less ASICS than you think !!!!" << std::endl;
+              std::cerr << "-----> " << dataEnable << "\t" << minEnable<< "\t"<< config->NUM_ASIC << std::endl;
+              std::cerr << "==============================================================" << std::endl;
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+            }
+            if (dataEnable > maxEnable ){
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+              std::cerr << "==============================================================" << std::endl;
+              std::cerr << "ATTENTION:: You are enabling more ASICS than you should !!!!" << std::endl;
+              std::cerr << "-----> " << dataEnable << "\t" << maxEnable << "\t"<< config->NUM_ASIC << std::endl;
+              std::cerr << "==============================================================" << std::endl;
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+              std::cerr << "!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
+            }
+        }
+        if (header.machine_gun >= 0) {
+            config->MAX_SAMPLES = header.machine_gun;
+            std::cout << "Resetting MAX_SAMPLES to " << config->MAX_SAMPLES << std::endl;
+        }
+        if (header.jumbo_enable >= 0) {
+            // 0 if off, 1 if on
+            if (header.jumbo_enable) {
+                config->PACKET_SIZE = 8846;
+            } else {
+                config->PACKET_SIZE = 1358;
             }
+            std::cout << "Setting PACKET_SIZE to " << config->PACKET_SIZE << std::endl;
         }
-        runfile.close();
     } else {
         std::cerr << "Failed to open run file: " << run_file << std::endl;
     }
@@ -151,6 +208,7 @@ void load_configs(std::string config_file, int run, int debug) {
     std::cout << "\n\n";
     print_configs();
     std::cout << "\n\n";
+    geometry::get_instance()->build();
 }
 
 void print_configs() {
@@ -207,9 +265,42 @@ void print_configs() {
     std::cout << "NUM_LINES: " << config->NUM_LINES << std::endl;
     std::cout << "MAX_SAMPLES: " << config->MAX_SAMPLES << std::endl;
     std::cout << "MACHINE_GUN_MAX_TIME: " << config->MACHINE_GUN_MAX_TIME << std::endl;
+    std::cout << "WAVEFORM_ADC_BINS: " << config->WAVEFORM_ADC_BINS << std::endl;
     
 
     std::cout << "PACKET_SIZE: " << config->PACKET_SIZE << std::endl;
+    std::cout << "LOAD_SHED_BACKLOG_MB: " << config->LOAD_SHED_BACKLOG_MB << std::endl;
+    std::cout << "LOAD_SHED_MAX_PRESCALE: " << config->LOAD_SHED_MAX_PRESCALE << std::endl;
+    std::cout << "LOAD_SHED_BURST: " << config->LOAD_SHED_BURST << std::endl;
+    std::cout << "CHECKPOINT_INTERVAL: " << config->CHECKPOINT_INTERVAL << std::endl;
+    std::cout << "ROLLING_WINDOWS:";
+    for (auto minutes : config->ROLLING_WINDOWS) {
+        std::cout << " " << minutes;
+    }
+    std::cout << std::endl;
+    std::cout << "ROLLING_SLICES: " << config->ROLLING_SLICES << std::endl;
+    std::cout << "ROLLING_WAVEFORMS: " << config->ROLLING_WAVEFORMS << std::endl;
+    std::cout << "ZS_THRESHOLD: " << config->ZS_THRESHOLD << std::endl;
+    std::cout << "ZS_KEEP_TOT_TOA: " << config->ZS_KEEP_TOT_TOA << std::endl;
+    std::cout << "OCCUPANCY_THRESHOLD: " << config->OCCUPANCY_THRESHOLD << std::endl;
+    std::cout << "OCCUPANCY_MIN_READOUTS: " << config->OCCUPANCY_MIN_READOUTS << std::endl;
+    std::cout << "OCCUPANCY_HOT_FACTOR: " << config->OCCUPANCY_HOT_FACTOR << std::endl;
+    std::cout << "OCCUPANCY_DEAD_PERCENT: " << config->OCCUPANCY_DEAD_PERCENT << std::endl;
+    std::cout << "WAVEFORM_RING_SIZE: " << config->WAVEFORM_RING_SIZE << std::endl;
+    std::cout << "EVENT_DISPLAY_INTERVAL: " << config->EVENT_DISPLAY_INTERVAL << std::endl;
+    std::cout << "RECO_CHANNEL_THRESHOLD: " << config->RECO_CHANNEL_THRESHOLD << std::endl;
+    std::cout << "UDP_PORT: " << config->UDP_PORT << std::endl;
+    std::cout << "UDP_BIND_ADDRESS: " << config->UDP_BIND_ADDRESS << std::endl;
+    std::cout << "UDP_RCVBUF_MB: " << config->UDP_RCVBUF_MB << std::endl;
+    std::cout << "UDP_BATCH: " << config->UDP_BATCH << std::endl;
+    std::cout << "SHM_EXPORT: " << config->SHM_EXPORT << std::endl;
+    std::cout << "WORKER_FPGAS:";
+    for (auto fpga : config->WORKER_FPGAS) {
+        std::cout << " " << fpga;
+    }
+    std::cout << std::endl;
+    std::cout << "AGGREGATOR: " << config->AGGREGATOR << std::endl;
+    std::cout << "AGGREGATOR_LISTEN: " << config->AGGREGATOR_LISTEN << std::endl;
 
 }
 
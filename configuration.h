@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <utility>
+#include <vector>
 
 class configuration {
 private:
@@ -28,6 +30,9 @@ public:
     int MAX_ADC = 1 << 10;
     int MAX_TOT = 1 << 12;
     int MAX_TOA = 1 << 10;
+    // ADC bins of the per channel waveform histograms, MAX_SAMPLES x this many counts per channel.
+    // Fewer bins save memory at the cost of ADC resolution.
+    int WAVEFORM_ADC_BINS = 1024;
     int FILE_VERSION_MAJOR = 0;
     int FILE_VERSION_MINOR = 0;
 
@@ -47,6 +52,84 @@ public:
     
     int PACKET_SIZE = 1452;
     int EVENT_ALIGNMENT_TOLERANCE = 4;
+    // Milliseconds between event display updates, 0 disables
+    int EVENT_DISPLAY_INTERVAL = 1000;
+    // Channels below this amplitude (ADC over pedestal) are left out of the shower summary
+    int RECO_CHANNEL_THRESHOLD = 10;
+
+    // Load shedding, 0 disables
+    // Once the unread part of the run file exceeds LOAD_SHED_BACKLOG_MB, only a fraction
+    // of the packets are decoded, down to 1/LOAD_SHED_MAX_PRESCALE
+    int LOAD_SHED_BACKLOG_MB = 0;
+    int LOAD_SHED_MAX_PRESCALE = 64;
+    int LOAD_SHED_BURST = 32;
+
+    // Seconds between checkpoints of the histograms and read position while following a run live, 0 disables
+    int CHECKPOINT_INTERVAL = 60;
+
+    // Rolling time window views of the per channel spectra, in minutes, empty disables
+    // Each window is kept as ROLLING_SLICES slices, so it covers the last (N-1)/N to all of its length
+    std::vector<int> ROLLING_WINDOWS = {1, 5, 30};
+    int ROLLING_SLICES = 5;
+    // Rolling copies of the waveforms too, they need several times the memory of the spectra
+    int ROLLING_WAVEFORMS = 0;
+
+    // Zero suppression, 0 disables
+    // Channels whose largest sample is less than ZS_THRESHOLD above the running pedestal don't get
+    // their waveform histogrammed or written to the tree, unless ZS_KEEP_TOT_TOA and they have a TOT or TOA
+    int ZS_THRESHOLD = 0;
+    int ZS_KEEP_TOT_TOA = 1;
+
+    // Channel occupancy, the fraction of readouts more than OCCUPANCY_THRESHOLD ADC above the
+    // pedestal (or with a TOT).  Once a channel has OCCUPANCY_MIN_READOUTS readouts, it is listed as
+    // hot above OCCUPANCY_HOT_FACTOR times the median occupancy, and as dead below
+    // OCCUPANCY_DEAD_PERCENT percent of it
+    int OCCUPANCY_THRESHOLD = 20;
+    int OCCUPANCY_MIN_READOUTS = 1000;
+    int OCCUPANCY_HOT_FACTOR = 10;
+    int OCCUPANCY_DEAD_PERCENT = 10;
+
+    // Raw waveforms kept per channel for inspecting individual pulses, 0 disables
+    int WAVEFORM_RING_SIZE = 16;
+
+    // Receive the packets over UDP on this port instead of reading the run file, 0 disables
+    // UDP_RCVBUF_MB is the socket buffer asked for, UDP_BATCH the packets read per system call
+    int UDP_PORT = 0;
+    std::string UDP_BIND_ADDRESS = "0.0.0.0";
+    int UDP_RCVBUF_MB = 64;
+    int UDP_BATCH = 64;
+
+    // Name of the POSIX shared memory segment the histograms are exported to each refresh, empty disables
+    std::string SHM_EXPORT = "";
+
+    // Distributed monitoring.  A worker only decodes WORKER_FPGAS (empty is all of them) and sends
+    // its histogram changes to the aggregator at AGGREGATOR, "unix:/path" or "host:port".  An
+    // aggregator reads no data itself, it listens at AGGREGATOR_LISTEN and adds up what the workers send.
+    std::vector<int> WORKER_FPGAS;
+    std::string AGGREGATOR = "";
+    std::string AGGREGATOR_LISTEN = "";
+
+    // Everything the buffers, histograms and channel maps are sized by when the monitor starts.
+    // A later run in the same process has to have the same values.
+    std::vector<std::pair<std::string, int>> layout() {
+        return {{"NUM_FPGA", NUM_FPGA}, {"NUM_ASIC", NUM_ASIC}, {"NUM_CHANNELS", NUM_CHANNELS}, {"MAX_SAMPLES", MAX_SAMPLES},
+                {"PACKET_SIZE", PACKET_SIZE}, {"WAVEFORM_ADC_BINS", WAVEFORM_ADC_BINS}, {"DETECTOR_ID", DETECTOR_ID}, {"SETUP_ID", SETUP_ID}};
+    }
+
+    bool reads_fpga(int fpga) {
+        if (WORKER_FPGAS.empty()) return true;
+        for (auto f : WORKER_FPGAS) {
+            if (f == fpga) return true;
+        }
+        return false;
+    }
+    // Added to output file names so workers of the same run don't overwrite each other
+    std::string output_tag() {
+        if (AGGREGATOR.empty()) return "";
+        std::string tag = "_worker";
+        for (auto f : WORKER_FPGAS) tag += "_" + std::to_string(f);
+        return tag;
+    }
 
 };
 
@@ -74,6 +74,23 @@ uint64_t bit_converter_64(uint8_t *buffer, int start, bool big_endian) {
            ((uint64_t)buffer[start + 3] << 24) + ((uint64_t)buffer[start + 2] << 16) + ((uint64_t)buffer[start + 1] << 8) + (uint64_t)buffer[start];
 }
 
+// Returns 2 for a heartbeat packet, otherwise 1 and fills in the UDP packet number and fpga
+int classify_packet(uint8_t *buffer, uint32_t &packet_number, uint32_t &fpga_id) {
+    packet_number = 0;
+    fpga_id = 0;
+    if (buffer[0] == 0x23 && buffer[1] == 0x23 && buffer[2] == 0x23 && buffer[3] == 0x23) {
+        return 2;
+    }
+    if (configuration::get_instance()->FILE_VERSION_MINOR > 12) {
+        packet_number = bit_converter(buffer, 0);
+        fpga_id = buffer[16] >> 4;
+    } else {
+        packet_number = (buffer[2] << 8) + (buffer[3]);
+        fpga_id = buffer[13];
+    }
+    return 1;
+}
+
 void decode_line(line &p, uint8_t *buffer) {
     p.asic_id = decode_asic(buffer[0]);
     p.fpga_id = decode_fpga(buffer[1]);
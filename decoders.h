@@ -17,6 +17,7 @@ int encode_asic(int asic_id);
 int decode_half(int half_id);
 int encode_half(int half_id);
 uint32_t bit_converter(uint8_t *buffer, int start, bool big_endian = true);
+int classify_packet(uint8_t *buffer, uint32_t &packet_number, uint32_t &fpga_id);
 void decode_line(line &p, uint8_t *buffer);
 int decode_packet(std::vector<line> &lines, uint8_t *buffer);
 void process_lines(std::vector<line> &lines, line_stream_vector &streams, TH1 *data_rates);
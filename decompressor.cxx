@@ -0,0 +1,107 @@
+#include "decompressor.h"
+
+#include <iostream>
+
+#include <zlib.h>
+
+static bool ends_with(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool decompressor::is_compressed(const std::string &fname) {
+    return ends_with(fname, ".gz") || ends_with(fname, ".zst");
+}
+
+decompressor::decompressor(const std::string &fname) {
+    gz = nullptr;
+    finished = false;
+#ifdef H2G_HAS_ZSTD
+    file = nullptr;
+    zstd = nullptr;
+    input_done = false;
+#endif
+    if (ends_with(fname, ".gz")) {
+        auto g = gzopen(fname.c_str(), "rb");
+        if (g != nullptr) {
+            gzbuffer(g, 1 << 20);
+        }
+        gz = g;
+    } else if (ends_with(fname, ".zst")) {
+#ifdef H2G_HAS_ZSTD
+        file = fopen(fname.c_str(), "rb");
+        if (file != nullptr) {
+            zstd = ZSTD_createDStream();
+            ZSTD_initDStream(zstd);
+            input = std::vector<char>(ZSTD_DStreamInSize());
+            in = {input.data(), 0, 0};
+        }
+#else
+        std::cerr << "Built without zstd, can't read " << fname << std::endl;
+#endif
+    }
+}
+
+decompressor::~decompressor() {
+    if (gz != nullptr) {
+        gzclose((gzFile)gz);
+    }
+#ifdef H2G_HAS_ZSTD
+    if (zstd != nullptr) {
+        ZSTD_freeDStream(zstd);
+    }
+    if (file != nullptr) {
+        fclose(file);
+    }
+#endif
+}
+
+bool decompressor::good() {
+#ifdef H2G_HAS_ZSTD
+    if (zstd != nullptr) {
+        return true;
+    }
+#endif
+    return gz != nullptr;
+}
+
+size_t decompressor::read(char *buffer, size_t size) {
+    size_t done = 0;
+    if (gz != nullptr) {
+        while (done < size && !finished) {
+            int n = gzread((gzFile)gz, buffer + done, size - done > (1u << 30) ? (1u << 30) : size - done);
+            if (n <= 0) {
+                if (n < 0) {
+                    int error;
+                    std::cerr << "gzip error: " << gzerror((gzFile)gz, &error) << std::endl;
+                }
+                finished = true;
+                break;
+            }
+            done += n;
+        }
+        return done;
+    }
+#ifdef H2G_HAS_ZSTD
+    if (zstd != nullptr) {
+        ZSTD_outBuffer out = {buffer, size, 0};
+        while (out.pos < out.size && !finished) {
+            if (in.pos == in.size && !input_done) {
+                in.size = fread(input.data(), 1, input.size(), file);
+                in.pos = 0;
+                input_done = in.size == 0;
+            }
+            // Once the input is used up, keep calling until the decoder has nothing left to flush
+            auto before = out.pos;
+            auto result = ZSTD_decompressStream(zstd, &out, &in);
+            if (ZSTD_isError(result)) {
+                std::cerr << "zstd error: " << ZSTD_getErrorName(result) << std::endl;
+                finished = true;
+            } else if (input_done && out.pos == before) {
+                finished = true;
+            }
+        }
+        return out.pos;
+    }
+#endif
+    return done;
+}
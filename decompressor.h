@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifdef H2G_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+// Reads a gzip (.gz) or zstd (.zst) compressed file as a plain byte stream.  zstd support
+// needs the library at build time, the Makefile turns it on when pkg-config finds it.
+class decompressor {
+private:
+    void *gz;               // gzFile, kept opaque so zlib.h stays out of the headers
+#ifdef H2G_HAS_ZSTD
+    FILE *file;
+    ZSTD_DStream *zstd;
+    std::vector<char> input;
+    ZSTD_inBuffer in;
+    bool input_done;
+#endif
+    bool finished;
+
+public:
+    decompressor(const std::string &fname);
+    ~decompressor();
+    // True for the file names this can read
+    static bool is_compressed(const std::string &fname);
+    bool good();
+    // Fill buffer as far as possible, returns the bytes read, less than size only at the end of the file
+    size_t read(char *buffer, size_t size);
+};
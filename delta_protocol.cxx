@@ -0,0 +1,116 @@
+#include "delta_protocol.h"
+
+#include <cstdio>
+#include <iostream>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//********************************************************************************************
+// Socket setup for both ends
+//********************************************************************************************
+static bool unix_address(const std::string &address, sockaddr_un &addr) {
+    if (address.compare(0, 5, "unix:") != 0) {
+        return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, address.c_str() + 5, sizeof(addr.sun_path) - 1);
+    return true;
+}
+
+static addrinfo *tcp_address(const std::string &address, bool passive) {
+    auto colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        std::cerr << "Bad address " << address << ", expected unix:/path or host:port" << std::endl;
+        return nullptr;
+    }
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    addrinfo *result = nullptr;
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (error != 0) {
+        std::cerr << "Could not resolve " << address << ": " << gai_strerror(error) << std::endl;
+        return nullptr;
+    }
+    return result;
+}
+
+int delta_listen(const std::string &address) {
+    sockaddr_un addr;
+    if (unix_address(address, addr)) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("socket");
+            return -1;
+        }
+        // Left over from an aggregator that didn't shut down cleanly
+        unlink(addr.sun_path);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+            perror("bind");
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    auto result = tcp_address(address, true);
+    if (result == nullptr) {
+        return -1;
+    }
+    int fd = socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+    int one = 1;
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0
+        || bind(fd, result->ai_addr, result->ai_addrlen) != 0 || listen(fd, 16) != 0) {
+        perror("bind");
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+int delta_connect(const std::string &address) {
+    sockaddr_un addr;
+    if (unix_address(address, addr)) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            fd = -1;
+        }
+        return fd;
+    }
+    auto result = tcp_address(address, false);
+    if (result == nullptr) {
+        return -1;
+    }
+    int fd = socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC, result->ai_protocol);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+void delta_put_string(std::vector<uint8_t> &message, const std::string &value) {
+    uint16_t length = value.size() < 65535 ? value.size() : 65535;
+    delta_put(message, length);
+    message.insert(message.end(), value.begin(), value.begin() + length);
+}
+
+std::string delta_reader::get_string() {
+    auto length = get<uint16_t>();
+    if (!ok || position + length > size) {
+        ok = false;
+        return "";
+    }
+    std::string value((const char*)data + position, length);
+    position += length;
+    return value;
+}
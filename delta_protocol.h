@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+//********************************************************************************************
+// Messages from the workers (delta_sender) to the aggregator (aggregator_stream).  Every
+// message is a delta_message_header followed by `length` bytes of payload, in the native byte
+// order, since both ends run on the same kind of machine.
+//
+// DELTA_CATALOG, sent once per connection:
+//   uint32 count, then per histogram: string folder, string name, uint32 cells
+// DELTA_UPDATE, sent every refresh, split over several messages if it's bigger than DELTA_MAX_MESSAGE:
+//   int32 run, uint32 fpgas, then per FPGA the worker reads: uint32 fpga, sequence_counts
+//   uint32 histograms, then per changed histogram: uint32 catalog index, double entries change,
+//   uint32 bins, then per changed bin: uint32 bin, double change
+// Strings are a uint16 length and the characters.
+//********************************************************************************************
+constexpr uint32_t DELTA_MAGIC = 0x44473248;     // "H2GD"
+constexpr uint32_t DELTA_CATALOG = 1;
+constexpr uint32_t DELTA_UPDATE = 2;
+// Payload size limit, the aggregator drops a worker that announces anything longer
+constexpr uint64_t DELTA_MAX_MESSAGE = 16 << 20;
+
+struct delta_message_header {
+    uint32_t magic;
+    uint32_t type;
+    uint64_t length;
+};
+
+// Addresses are "unix:/path/to/socket" or "host:port".  Both return -1 on failure.
+int delta_listen(const std::string &address);
+int delta_connect(const std::string &address);
+
+template <class T> void delta_put(std::vector<uint8_t> &message, T value) {
+    auto start = message.size();
+    message.resize(start + sizeof(T));
+    std::memcpy(message.data() + start, &value, sizeof(T));
+}
+
+void delta_put_string(std::vector<uint8_t> &message, const std::string &value);
+
+// Reads a payload front to back, `ok` goes false instead of reading past the end
+class delta_reader {
+private:
+    const uint8_t *data;
+    uint64_t size;
+    uint64_t position;
+
+public:
+    bool ok;
+    delta_reader(const uint8_t *data, uint64_t size) : data(data), size(size), position(0), ok(true) {}
+    template <class T> T get() {
+        T value{};
+        if (!ok || position + sizeof(T) > size) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, data + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+    std::string get_string();
+};
@@ -0,0 +1,187 @@
+#include "delta_sender.h"
+
+#include "delta_protocol.h"
+#include "configuration.h"
+#include "server.h"
+
+#include <TH1.h>
+#include <TProfile.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//********************************************************************************************
+// Pick up everything registered so far.  Profiles are left out, their contents are means
+// and don't add up across workers.
+//********************************************************************************************
+delta_sender::delta_sender(const char *address) {
+    this->address = address;
+    fd = -1;
+    std::set<TH1*> seen;
+    for (auto &entry : server::get_instance()->get_registered()) {
+        auto hist = dynamic_cast<TH1*>(entry.second);
+        if (hist == nullptr || hist->InheritsFrom(TProfile::Class()) || !seen.insert(hist).second) {
+            continue;
+        }
+        histograms.push_back(hist);
+        folders.push_back(entry.first);
+    }
+    sent.resize(histograms.size(), nullptr);
+    sent_entries.resize(histograms.size(), 0);
+    connect_aggregator();
+}
+
+delta_sender::~delta_sender() {
+    if (fd >= 0) {
+        close(fd);
+    }
+    for (auto copy : sent) {
+        delete copy;
+    }
+}
+
+bool delta_sender::connect_aggregator() {
+    fd = delta_connect(address);
+    if (fd < 0) {
+        std::cerr << "Aggregator " << address << " not reachable, trying again next refresh" << std::endl;
+        return false;
+    }
+    std::cout << "Connected to aggregator " << address << std::endl;
+    // The catalog tells the aggregator which of its histograms each index refers to
+    message.clear();
+    delta_put<uint32_t>(message, histograms.size());
+    for (size_t i = 0; i < histograms.size(); i++) {
+        delta_put_string(message, folders[i]);
+        delta_put_string(message, histograms[i]->GetName());
+        delta_put<uint32_t>(message, histograms[i]->GetNcells());
+    }
+    return send_message(DELTA_CATALOG);
+}
+
+bool delta_sender::send_message(uint32_t type) {
+    delta_message_header header = {DELTA_MAGIC, type, message.size()};
+    std::vector<uint8_t> out(sizeof(header) + message.size());
+    std::memcpy(out.data(), &header, sizeof(header));
+    std::memcpy(out.data() + sizeof(header), message.data(), message.size());
+    size_t done = 0;
+    while (done < out.size()) {
+        auto n = ::send(fd, out.data() + done, out.size() - done, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("send");
+            std::cerr << "Lost the aggregator, reconnecting next refresh" << std::endl;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+//********************************************************************************************
+// One update: the counters, then the changed bins of every histogram, in as many messages as
+// it takes to stay under DELTA_MAX_MESSAGE.  The copies of the last sent contents only move on
+// once a message is out, so nothing is lost if a send fails.
+//********************************************************************************************
+void delta_sender::send(int run_number, packet_stream *input) {
+    if (fd < 0 && !connect_aggregator()) {
+        return;
+    }
+    uint32_t total_changed = 0;
+    uint64_t total_size = 0;
+    begin_update(run_number, input);
+    for (size_t i = 0; i < histograms.size(); i++) {
+        auto hist = histograms[i];
+        if (sent[i] == nullptr) {
+            if (hist->GetEntries() == 0) {
+                continue;
+            }
+            sent[i] = (TH1*) hist->Clone(Form("%s_sent", hist->GetName()));
+            sent[i]->SetDirectory(nullptr);
+            sent[i]->Reset();
+        }
+        entry.clear();
+        delta_put<uint32_t>(entry, i);
+        delta_put<double>(entry, hist->GetEntries() - sent_entries[i]);
+        uint32_t bins = 0;
+        delta_put<uint32_t>(entry, 0);
+        for (int bin = 0; bin < hist->GetNcells(); bin++) {
+            double change = hist->GetBinContent(bin) - sent[i]->GetBinContent(bin);
+            if (change != 0) {
+                delta_put<uint32_t>(entry, bin);
+                delta_put<double>(entry, change);
+                bins++;
+            }
+        }
+        if (bins == 0 && hist->GetEntries() == sent_entries[i]) {
+            continue;
+        }
+        std::memcpy(entry.data() + sizeof(uint32_t) + sizeof(double), &bins, sizeof(bins));
+        if (count_position + sizeof(uint32_t) + entry.size() > DELTA_MAX_MESSAGE) {
+            std::cerr << hist->GetName() << " has too many changed bins to send" << std::endl;
+            continue;
+        }
+        if (message.size() + entry.size() > DELTA_MAX_MESSAGE) {
+            total_changed += changed;
+            total_size += message.size();
+            if (!finish_update()) {
+                return;
+            }
+            begin_update(run_number, input);
+        }
+        message.insert(message.end(), entry.begin(), entry.end());
+        changed++;
+    }
+    total_changed += changed;
+    total_size += message.size();
+    if (finish_update()) {
+        std::cout << "Sent " << total_changed << " changed histograms (" << total_size / 1024 << " kB) to the aggregator" << std::endl;
+    }
+}
+
+void delta_sender::begin_update(int run_number, packet_stream *input) {
+    auto config = configuration::get_instance();
+    message.clear();
+    delta_put<int32_t>(message, run_number);
+    std::vector<int> fpgas;
+    for (int fpga = 0; fpga < config->NUM_FPGA; fpga++) {
+        if (config->reads_fpga(fpga)) {
+            fpgas.push_back(fpga);
+        }
+    }
+    delta_put<uint32_t>(message, fpgas.size());
+    for (auto fpga : fpgas) {
+        delta_put<uint32_t>(message, fpga);
+        delta_put<sequence_counts>(message, input->get_sequence_counts(fpga));
+    }
+    count_position = message.size();
+    changed = 0;
+    delta_put<uint32_t>(message, 0);
+}
+
+// Send the message and move the copies on by what was in it
+bool delta_sender::finish_update() {
+    std::memcpy(message.data() + count_position, &changed, sizeof(changed));
+    auto size = message.size();
+    if (!send_message(DELTA_UPDATE)) {
+        return false;
+    }
+    delta_reader reader(message.data() + count_position + sizeof(uint32_t), size - count_position - sizeof(uint32_t));
+    for (uint32_t h = 0; h < changed; h++) {
+        auto i = reader.get<uint32_t>();
+        sent_entries[i] += reader.get<double>();
+        auto bins = reader.get<uint32_t>();
+        for (uint32_t b = 0; b < bins; b++) {
+            auto bin = reader.get<uint32_t>();
+            sent[i]->AddBinContent(bin, reader.get<double>());
+        }
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "packet_stream.h"
+
+#include <TH1.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Worker side of a distributed monitor.  Every refresh, sends the aggregator what changed in
+// each registered histogram since the last refresh, bin by bin, and the packet counters of
+// the FPGAs this worker reads.  A histogram gets a copy of its last sent contents the first
+// time it has entries, so a worker only keeps copies of the histograms of its own FPGAs.  The
+// copy is a clone of the same histogram class, so integer histograms stay integers.
+class delta_sender {
+private:
+    std::string address;
+    int fd;                                     // -1 while not connected
+    std::vector<TH1*> histograms;
+    std::vector<std::string> folders;
+    std::vector<TH1*> sent;                     // [histogram], nullptr until it has entries
+    std::vector<double> sent_entries;
+    std::vector<uint8_t> message;
+    std::vector<uint8_t> entry;                 // One histogram's changes, before it goes into the message
+    size_t count_position;                      // Of the changed histogram count in the message
+    uint32_t changed;
+
+    bool connect_aggregator();
+    bool send_message(uint32_t type);
+    void begin_update(int run_number, packet_stream *input);
+    bool finish_update();
+
+public:
+    delta_sender(const char *address);
+    ~delta_sender();
+    void send(int run_number, packet_stream *input);
+};
@@ -4,6 +4,7 @@
 #include "server.h"
 #include "canvas_manager.h"
 #include "single_channel_tree.h"
+#include "metrics.h"
 
 #include <cstdint>
 #include <iostream>
@@ -22,6 +23,14 @@ single_channel_event::single_channel_event(uint32_t fpga_id, uint32_t channel, u
     this->expected_samples = expected_samples;
     this->found_samples = 0;
     this->complete = false;
+    this->max_sample = 0;
+    this->max_tot = 0;
+    this->max_toa = 0;
+    this->kept = true;
+    this->amplitude = 0;
+    this->integral = 0;
+    this->peak_time = 0;
+    this->peak_sample = 0;
 
     this->timestamps = new uint32_t[expected_samples];
     this->samples = new uint32_t[expected_samples];
@@ -32,7 +41,7 @@ single_channel_event::~single_channel_event() {
     delete[] this->samples;
 }
 
-bool single_channel_event::add_sample(uint32_t timestamp, uint32_t sample) {
+bool single_channel_event::add_sample(uint32_t timestamp, uint32_t sample, uint32_t tot, uint32_t toa) {
     auto config = configuration::get_instance();
     // Make sure the event isn't already complete
     if (this->found_samples >= this->expected_samples) {
@@ -53,6 +62,9 @@ bool single_channel_event::add_sample(uint32_t timestamp, uint32_t sample) {
     this->timestamps[this->found_samples] = timestamp;
     this->samples[this->found_samples] = sample;
     this->found_samples++;
+    if (sample > this->max_sample) this->max_sample = sample;
+    if (tot > this->max_tot) this->max_tot = tot;
+    if (toa > this->max_toa) this->max_toa = toa;
 
     if (this->found_samples == this->expected_samples) {
         this->complete = true;
@@ -61,16 +73,21 @@ bool single_channel_event::add_sample(uint32_t timestamp, uint32_t sample) {
     return true;
 }
 
-void single_channel_event::fill_waveform(TH2 *waveform, TH1 *max) {
+// Returns the largest sample
+int single_channel_event::fill_waveform(TH2 *waveform, TH1 *max, rolling_histogram *rolling) {
     int max_sample =0;
     int pedestal = samples[0];
     for (int i = 0; i < this->found_samples; i++) {
         waveform->Fill(i, this->samples[i]);
+        if (rolling != nullptr) {
+            rolling->fill(i, this->samples[i]);
+        }
         if (this->samples[i] > max_sample) {
             max_sample = this->samples[i];
         }
     }
     max->Fill(max_sample - pedestal);
+    return max_sample;
 }
 
 int single_channel_event::get_max_sample() {
@@ -94,6 +111,12 @@ void single_channel_event::write_to_tree() {
     tree->current_asic_id = asic_id;
     tree->pedestal = samples[0];
     tree->max_sample = samples[0];
+    tree->ToA = max_toa;
+    tree->ToT = max_tot;
+    tree->amplitude = amplitude;
+    tree->integral = integral;
+    tree->peak_time = peak_time;
+    tree->peak_sample = peak_sample;
     for (int i = 0; i < found_samples; i++) {
         tree->samples[i] = samples[i];
         if (samples[i] > tree->max_sample) {
@@ -117,22 +140,38 @@ kcu_event::kcu_event(uint32_t ts, uint32_t fpga) {
 kcu_event::~kcu_event() {
 }
 
+void kcu_event::release() {
+    for (auto &c : channels) {
+        delete c;
+        c = nullptr;
+    }
+    channels_found = 0;
+}
+
+// Events that never complete, or that nobody takes out of the completed buffer, are dropped
+// past these so a missing channel or a stalled thunderdome can't eat all the memory
+static const size_t max_in_progress_events = 256;
+static const size_t max_completed_events = 4096;
+
 event_builder::event_builder(uint32_t fpga) {
     fpga_id = fpga;
 
     completed_events = 0;
     attempted_events = 0;
+    dropped_events = 0;
+    overflow_events = 0;
 
     auto canvases = canvas_manager::get_instance();
-    auto s = server::get_instance()->get_server();
+    auto s = server::get_instance();
     auto canvas_id = canvases.new_canvas(Form("FPGA_%i_Events", fpga_id), Form("FPGA %i Events", fpga_id), 1200, 800);
-    s->Register("/QA Plots/DAQ Performance", canvases.get_canvas(canvas_id));
+    s->register_object("/QA Plots/DAQ Performance", canvases.get_canvas(canvas_id));
     TLegend *legend = new TLegend(0.15, 0.75, 0.48, 0.9);
     legend->SetBorderSize(0);
     
     events_attempted = new TGraph();
     events_attempted->SetName(Form("fpga_%i_events_attempted", fpga_id));
     gROOT->Add(events_attempted);
+    attempted_series = new timeseries(events_attempted, timeseries::MAX);
     events_attempted->SetTitle(Form("FPGA %i Events Attempted", fpga_id));
     events_attempted->GetXaxis()->SetTitle("Time");
     events_attempted->GetXaxis()->SetTimeDisplay(1);
@@ -146,6 +185,7 @@ event_builder::event_builder(uint32_t fpga) {
     events_complete = new TGraph();
     events_complete->SetName(Form("fpga_%i_events_completed", fpga_id));
     gROOT->Add(events_complete);
+    complete_series = new timeseries(events_complete, timeseries::MAX);
     events_complete->SetTitle(Form("FPGA %i Events Completed", fpga_id));
     events_complete->GetXaxis()->SetTitle("Time");
     events_complete->GetXaxis()->SetTimeDisplay(1);
@@ -161,6 +201,7 @@ event_builder::event_builder(uint32_t fpga) {
     missed_event_fraction = new TGraph();
     missed_event_fraction->SetName(Form("fpga_%i_incomplete_events_percent", fpga_id));
     gROOT->Add(missed_event_fraction);
+    missed_series = new timeseries(missed_event_fraction, timeseries::MAX);
     missed_event_fraction->SetTitle(Form("FPGA %i Incomplete Events Percent", fpga_id));
     missed_event_fraction->GetXaxis()->SetTitle("Time");
     missed_event_fraction->GetXaxis()->SetTimeDisplay(1);
@@ -177,200 +218,214 @@ event_builder::event_builder(uint32_t fpga) {
 }
 
 event_builder::~event_builder() {
+    delete attempted_series;
+    delete complete_series;
+    delete missed_series;
 }
  
 void event_builder::channel_hit(single_channel_event *single) {
-    // Check if there is already an event for this timestamp
-    bool found = false;
-    for (auto e = in_progress_event_buffer.end(); e != in_progress_event_buffer.begin(); e--) {
-        if (e->timestamp == single->timestamps[0]) {
-            found = true;
+    int index = single->channel + configuration::get_instance()->NUM_CHANNELS * single->asic_id;
+    // Check if there is already an event for this timestamp, it's most likely one of the newest
+    for (auto e = in_progress_event_buffer.rbegin(); e != in_progress_event_buffer.rend(); e++) {
+        if (e->timestamp != single->timestamps[0]) {
+            continue;
+        }
+        if (e->channels[index] != nullptr) {
+            // Same channel twice for one timestamp, keep the newer one
+            delete e->channels[index];
+        } else {
             e->channels_found++;
-            e->channels[single->channel + configuration::get_instance()->NUM_CHANNELS * single->asic_id] = single;
-            if (e->is_complete()) {
-                completed_events++;
-                completed_event_buffer.push_back(*e);
-                in_progress_event_buffer.erase(e);
+        }
+        e->channels[index] = single;
+        if (e->is_complete()) {
+            completed_events++;
+            metrics::add(metrics::get_instance()->events_complete, fpga_id);
+            completed_event_buffer.push_back(std::move(*e));
+            in_progress_event_buffer.erase(std::next(e).base());
+            if (completed_event_buffer.size() > max_completed_events) {
+                completed_event_buffer.front().release();
+                completed_event_buffer.pop_front();
+                overflow_events++;
+                metrics::add(metrics::get_instance()->events_overflow, fpga_id);
             }
-            break;
         }
+        return;
     }
-    if (!found) {
-        // Create a new event
-        attempted_events++;
-        kcu_event e(single->timestamps[0], single->fpga_id);
-        e.channels_found++;
-        e.channels[single->channel] = single;
-        in_progress_event_buffer.push_back(e);
+
+    // Create a new event
+    attempted_events++;
+    metrics::add(metrics::get_instance()->events_attempted, fpga_id);
+    in_progress_event_buffer.emplace_back(single->timestamps[0], single->fpga_id);
+    auto &e = in_progress_event_buffer.back();
+    e.channels_found++;
+    e.channels[index] = single;
+    if (in_progress_event_buffer.size() > max_in_progress_events) {
+        in_progress_event_buffer.front().release();
+        in_progress_event_buffer.pop_front();
+        dropped_events++;
+        metrics::add(metrics::get_instance()->events_dropped, fpga_id);
     }
 }
 
 void event_builder::update_stats() {
-    std::cout << "FPGA " << fpga_id << " completed " << completed_events << "/" << attempted_events << " events." << std::endl;
+    std::cout << "FPGA " << fpga_id << " completed " << completed_events << "/" << attempted_events << " events, dropped " << dropped_events << " incomplete and " << overflow_events << " complete ones that weren't aligned in time." << std::endl;
     auto time = TDatime();
-    events_attempted->SetPoint(events_attempted->GetN(), time.Convert(), attempted_events);
-    events_complete->SetPoint(events_complete->GetN(), time.Convert(), completed_events);
+    attempted_series->add(time.Convert(), attempted_events);
+    complete_series->add(time.Convert(), completed_events);
     events_attempted->GetYaxis()->SetRangeUser(0, 1.2 * (float)attempted_events);
-    missed_event_fraction->SetPoint(missed_event_fraction->GetN(), time.Convert(), 1 - (float)(completed_events) / attempted_events);
+    missed_series->add(time.Convert(), 1 - (float)(completed_events) / attempted_events);
 
 }
 
+void event_builder::start_run() {
+    for (auto &e : in_progress_event_buffer) {
+        e.release();
+    }
+    for (auto &e : completed_event_buffer) {
+        e.release();
+    }
+    in_progress_event_buffer.clear();
+    completed_event_buffer.clear();
+    attempted_events = 0;
+    completed_events = 0;
+    dropped_events = 0;
+    overflow_events = 0;
+}
+
 
-event_thunderdome::event_thunderdome(event_builder **b) {
+event_thunderdome::event_thunderdome(event_builder **b, int debug) {
     builders = b;
+    num_fpga = configuration::get_instance()->NUM_FPGA;
+    this->debug = debug;
+    total_built = 0;
+    drift = new clock_drift(num_fpga, debug);
+    intervals = std::vector<uint32_t>(num_fpga, 0);
 }
 
 event_thunderdome::~event_thunderdome() {
+    clear_events();
+    for (auto &e : latest_event) {
+        e.release();
+    }
+    delete drift;
 }
 
+// Everything but the newest event is freed, that one is kept for the event display
 void event_thunderdome::clear_events() {
+    if (built_events.size() > 0) {
+        for (auto &e : latest_event) {
+            e.release();
+        }
+        latest_event = std::move(built_events.back());
+        built_events.pop_back();
+    }
+    for (auto &events : built_events) {
+        for (auto &e : events) {
+            e.release();
+        }
+    }
     built_events.clear();
 }
 
+void event_thunderdome::start_run() {
+    clear_events();
+    for (auto &e : latest_event) {
+        e.release();
+    }
+    latest_event.clear();
+    first_event = true;
+    for (int i = 0; i < num_fpga; i++) {
+        builders[i]->start_run();
+    }
+}
+
+void event_thunderdome::drop_front(int fpga) {
+    auto &buffer = builders[fpga]->completed_event_buffer;
+    buffer.front().release();
+    buffer.pop_front();
+}
+
+//********************************************************************************************
+// Match up the completed events of each FPGA.  Timestamps are compared relative to the last
+// matched event on each FPGA, since the clocks don't share an origin.  If the fronts don't
+// agree within EVENT_ALIGNMENT_TOLERANCE, the one furthest behind can't have a partner and is
+// dropped.  Each FPGA's interval is first converted to FPGA 0 ticks with the running clock
+// drift estimate, so the tolerance doesn't have to cover the drift over long gaps.
+//********************************************************************************************
 void event_thunderdome::align_events() {
-    // how many events are sitting in the buffer?
-    uint32_t max_event_buffer = 0;
-    // std::cout << std::endl;
-    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-        std::cout << "FPGA " << i << " has " << builders[i]->completed_event_buffer.size() << " events in the buffer." << std::endl;
+    auto tolerance = configuration::get_instance()->EVENT_ALIGNMENT_TOLERANCE;
+    for (int i = 0; i < num_fpga; i++) {
+        if (debug > 1) {
+            std::cout << "FPGA " << i << " has " << builders[i]->completed_event_buffer.size() << " events in the buffer." << std::endl;
+        }
         if (builders[i]->completed_event_buffer.size() == 0) {
             return;
         }
-        if (builders[i]->completed_event_buffer.size() > max_event_buffer) {
-            max_event_buffer = builders[i]->completed_event_buffer.size();
-        }        
-    }
-    if (max_event_buffer == 0) {
-        // No events, why did this get called?  Also need to check for the minimim number of events available, but eh
-        return;
     }
 
     // Get the first event from each FPGA to create an offset
     if (first_event) {
         first_event = false;
-        for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-            if (builders[i]->completed_event_buffer.size() > 0) {
-                auto e = builders[i]->completed_event_buffer.front();
-                event_t0.push_back(e.timestamp);
-            }
+        event_t0.clear();
+        for (int i = 0; i < num_fpga; i++) {
+            event_t0.push_back(builders[i]->completed_event_buffer.front().timestamp);
         }
-        std::cout << "Event t0s: ";
-        for (auto t : event_t0) {
-            std::cout << std::setfill('0') << std::setw(2) << t << " ";
+        if (debug > 0) {
+            std::cout << "Event t0s: ";
+            for (auto t : event_t0) {
+                std::cout << std::setfill('0') << std::setw(2) << t << " ";
+            }
+            std::cout << std::endl;
         }
     }
 
-    // Now we need to align the events
-    bool running = true;
-    while (running) {
-        // if any buffers are empty, stop
-        for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-            std::cout << "builder " << i << " has " << builders[i]->completed_event_buffer.size() << " events in the buffer." << std::endl;
-            if (builders[i]->completed_event_buffer.size() == 0) {
-                running = false;
+    while (true) {
+        double min = 1e300;
+        double max = 0;
+        int behind = 0;
+        bool empty = false;
+        for (int i = 0; i < num_fpga && !empty; i++) {
+            auto &buffer = builders[i]->completed_event_buffer;
+            // Anything before the last matched event is stale
+            while (buffer.size() > 0 && buffer.front().timestamp < event_t0[i]) {
+                drop_front(i);
+            }
+            if (buffer.size() == 0) {
+                empty = true;
                 break;
             }
-        }
-        std::cout << "\nClock values: ";
-        for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-            if (builders[i]->completed_event_buffer.size() > 0) {
-                std::cout << std::setfill('0') << std::setw(2) << builders[i]->completed_event_buffer.front().timestamp << " ";
+            intervals[i] = buffer.front().timestamp - event_t0[i];
+            double ts = drift->to_reference(i, intervals[i]);
+            if (ts < min) {
+                min = ts;
+                behind = i;
+            }
+            if (ts > max) {
+                max = ts;
             }
         }
-        std::cout << std::endl;
-        std::cout << "t0 values: ";
-        for (auto t : event_t0) {
-            std::cout << std::setfill('0') << std::setw(2) << t << " ";
-        }
-        std::cout << std::endl;
-
-        
-        uint32_t min = 0xFFFFFFFF;
-        uint32_t max = 0;
-        float mean = 0;
-        for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-            auto e = builders[i]->completed_event_buffer.front();
-            auto ts = e.timestamp - event_t0[i];
-            if (ts < min) {min = ts;}
-            if (ts > max) {max = ts;}
-            mean += (float)ts;
+        if (empty) {
+            break;
         }
-        mean /= configuration::get_instance()->NUM_FPGA;
-
 
-        auto range = max - min;
-        if (range < configuration::get_instance()->EVENT_ALIGNMENT_TOLERANCE) {
-            // We have an event!
-            std::cout << "Found an event!  Range is " << range << std::endl;
+        if (max - min < tolerance) {
+            drift->add_match(intervals);
             std::vector<kcu_event> events;
-            for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-                auto e = builders[i]->completed_event_buffer.front();
-                event_t0[i] = e.timestamp;
-                events.push_back(e);   // Reset our reference frame
-                builders[i]->completed_event_buffer.pop_front();
-                if (builders[i]->completed_event_buffer.size() == 0) {
-                    running = false;
-                }
+            events.reserve(num_fpga);
+            for (int i = 0; i < num_fpga; i++) {
+                auto &buffer = builders[i]->completed_event_buffer;
+                event_t0[i] = buffer.front().timestamp;     // Reset our reference frame
+                events.push_back(std::move(buffer.front()));
+                buffer.pop_front();
             }
-            if (running == false) {
-                break;
-            }
-            std::cout << "pushing back event with " << events.size() << " FPGAs" << std::endl;
-            built_events.push_back(events);
-
-
+            built_events.push_back(std::move(events));
+            total_built++;
+            metrics::get_instance()->events_aligned.fetch_add(1, std::memory_order_relaxed);
         } else {
-            // We don't have an event, so we need to shift the events
-            std::cout << "no event found :(  range is " << range << std::endl;
-
-            std::cout << "fpga 0 ts: " << builders[0]->completed_event_buffer.front().timestamp << std::endl;
-            std::cout << "fpga 1 ts: " << builders[1]->completed_event_buffer.front().timestamp << std::endl;
-            std::cout << "fpga 2 ts: " << builders[2]->completed_event_buffer.front().timestamp << std::endl;
-            std::cout << "fpga 3 ts: " << builders[3]->completed_event_buffer.front().timestamp << std::endl;
-            
-            // Find the event farthest from the mean
-            int max_deviation = 0;
-            int max_deviation_index = 0;
-            for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-                auto e = builders[i]->completed_event_buffer.front();
-                while (e.timestamp < event_t0[i]) {
-                    builders[i]->completed_event_buffer.pop_front();
-                    if (builders[i]->completed_event_buffer.size() == 0) {
-                        running = false;
-                        break;
-                    }
-                    e = builders[i]->completed_event_buffer.front();
-                }
-                auto ts = e.timestamp - event_t0[i];
-                if (abs(ts - mean) > max_deviation) {
-                    max_deviation = abs(ts - mean);
-                    max_deviation_index = i;
-                }
-                max_deviation = (builders[max_deviation_index]->completed_event_buffer.front().timestamp - event_t0[max_deviation_index]) - mean;
-            }
-
-            // std::cout << "max deviation is " << max_deviation << " at index " << max_deviation_index << std::endl;
-            // if the max deviation is above the mean, we drop all other channels
-            if (max_deviation > 0) {
-                for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-                    if (i != max_deviation_index) {
-                        std::cout << "running path a" << std::endl;
-                        builders[i]->completed_event_buffer.pop_front();
-                        if (builders[i]->completed_event_buffer.size() == 0) {
-                            running = false;
-                            break;
-                        }
-                    }
-                }
-            } else {
-                // We need to shift the events
-                std::cout << "running path b" << std::endl;
-                builders[max_deviation_index]->completed_event_buffer.pop_front();
-                if (builders[max_deviation_index]->completed_event_buffer.size() == 0) {
-                    running = false;
-                    break;
-                }
+            if (debug > 1) {
+                std::cout << "No event found, range is " << max - min << ", dropping front of FPGA " << behind << std::endl;
             }
+            drop_front(behind);
         }
     }
 }
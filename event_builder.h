@@ -1,6 +1,9 @@
 #pragma once
 
 #include "configuration.h"
+#include "rolling_histogram.h"
+#include "clock_drift.h"
+#include "timeseries.h"
 
 #include <cstdint>
 #include <queue>
@@ -23,20 +26,43 @@ private:
 
     uint32_t *timestamps;
     uint32_t *samples;
+    // Kept up to date as samples come in, so nothing needs to loop over them again
+    uint32_t max_sample;
+    uint32_t max_tot;
+    uint32_t max_toa;
+    // Set by zero suppression and the pulse feature kernel
+    bool kept;
+    float amplitude;
+    float integral;
+    float peak_time;
+    int peak_sample;
 
 public:
     single_channel_event(uint32_t fpga_id, uint32_t channel, uint32_t asic_id, uint32_t expected_samples);
     ~single_channel_event();
 
     int get_fpga_id() {return this->fpga_id;}
-    bool add_sample(uint32_t timestamp, uint32_t sample);
+    bool add_sample(uint32_t timestamp, uint32_t sample, uint32_t tot, uint32_t toa);
     bool is_complete() {return this->complete;}
-    void fill_waveform(TH2 *waveform, TH1 *max);
+    bool is_kept() {return this->kept;}
+    void set_kept(bool kept) {this->kept = kept;}
+    uint32_t get_found_samples() {return this->found_samples;}
+    const uint32_t *get_samples() {return this->samples;}
+    const uint32_t *get_timestamps() {return this->timestamps;}
+    uint32_t get_max_adc() {return this->max_sample;}
+    uint32_t get_max_tot() {return this->max_tot;}
+    uint32_t get_max_toa() {return this->max_toa;}
+    float get_amplitude() {return this->amplitude;}
+    float get_integral() {return this->integral;}
+    float get_peak_time() {return this->peak_time;}
+    int get_peak_sample() {return this->peak_sample;}
+    int fill_waveform(TH2 *waveform, TH1 *max, rolling_histogram *rolling);
     int get_max_sample();
     void write_to_tree();
 
     friend class kcu_event;
     friend class event_builder;
+    friend class pulse_features;
 };
 
 class kcu_event {
@@ -57,7 +83,10 @@ public:
 
     bool is_complete() {return channels_found == configuration::get_instance()->NUM_ASIC * configuration::get_instance()->NUM_CHANNELS;}
     uint32_t get_fpga_id() {return fpga_id;}
+    uint32_t get_timestamp() {return timestamp;}
     single_channel_event* get_channel(int channel) {return channels[channel];}
+    // kcu_events are passed around by value, whoever drops one for good frees its channels
+    void release();
 
 };
 
@@ -70,10 +99,15 @@ private:
     std::list<kcu_event> completed_event_buffer;
     int attempted_events;
     int completed_events;
+    int dropped_events;
+    int overflow_events;        // Completed, but pushed out before the thunderdome took them
 
     TGraph *events_attempted;
     TGraph *events_complete;
     TGraph *missed_event_fraction;
+    timeseries *attempted_series;
+    timeseries *complete_series;
+    timeseries *missed_series;
     
     void reset_event();
 
@@ -83,6 +117,7 @@ public:
 
     void channel_hit(single_channel_event *single);
     void update_stats();
+    void start_run();
 
     friend class event_thunderdome;
 };
@@ -91,19 +126,32 @@ public:
 class event_thunderdome {
 private:
     event_builder **builders;
+    int num_fpga;
+    int debug;
     std::vector<std::vector<kcu_event>> built_events;
-    std::vector<std::vector<uint32_t>> event_timestamps;
+    // The newest built event survives clear_events() for the event display
+    std::vector<kcu_event> latest_event;
+    uint64_t total_built;
     bool first_event = true;
     std::vector<uint32_t> event_t0;
+    clock_drift *drift;
+    std::vector<uint32_t> intervals;    // Scratch, ticks since the last match on each FPGA
+
+    void drop_front(int fpga);
 
 public:
-    event_thunderdome(event_builder **b);
+    event_thunderdome(event_builder **b, int debug = 0);
     ~event_thunderdome();
 
     void align_events();
     void clear_events();
+    // Timestamps start over with each run, the clock drift estimate is kept
+    void start_run();
 
     uint32_t get_num_events(){return built_events.size();}
-    std::vector<kcu_event> get_event(int n) {return built_events[n];}
+    std::vector<kcu_event> &get_event(int n) {return built_events[n];}
     int get_num_events(int n) {return built_events[n].size();}
+    std::vector<kcu_event> &get_latest_event() {return latest_event;}
+    uint64_t get_total_built() {return total_built;}
+    void update_drift() {drift->update_graphs();}
 };
@@ -1,112 +1,121 @@
 #include "file_stream.h"
 
 #include "configuration.h"
-#include "canvas_manager.h"
-#include "server.h"
+#include "decoders.h"
+#include "run_header.h"
 
-#include <TGraph.h>
-#include <TMultiGraph.h>
-#include <TCanvas.h>
-#include <TAxis.h>
-#include <TROOT.h>
-#include <TDatime.h>
-#include <TLegend.h>
+#include <TParameter.h>
+#include <TSystem.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
 
 //********************************************************************************************
 // Setup file stream 
 //********************************************************************************************
 file_stream::file_stream(const char *fname) {
-    auto config     = configuration::get_instance();    
-    current_packet  = new uint32_t[config->NUM_FPGA];
-    missed_packets  = new uint32_t[config->NUM_FPGA];
-    total_packets   = new uint32_t[config->NUM_FPGA];
-    canvas_id       = new int[config->NUM_FPGA];
-    first_packet    = new bool[config->NUM_FPGA];
-    received_packet_graphs        = new TGraph*[config->NUM_FPGA];
-    missed_packet_graphs          = new TGraph*[config->NUM_FPGA];
-    missed_packet_graphs_percent  = new TGraph*[config->NUM_FPGA];
-    mg              = new TMultiGraph*[config->NUM_FPGA];
-
-    auto canvases = canvas_manager::get_instance();
-    auto s = server::get_instance()->get_server();
-    for (int i = 0; i < config->NUM_FPGA; i++) {
-        current_packet[i] = 0;
-        missed_packets[i] = 0;
-        total_packets[i] = 0;
-        
-        canvas_id[i] = canvases.new_canvas(Form("FPGA_Events_%i_Packets", i), Form("FPGA %i Packets", i), 1200, 800);
-        s->Register("/QA Plots/DAQ Performance", canvases.get_canvas(canvas_id[i]));
-        TLegend *legend = new TLegend(0.15, 0.75, 0.48, 0.9);
-        legend->SetBorderSize(0);
-        
-        received_packet_graphs[i] = new TGraph();
-        received_packet_graphs[i]->SetName(Form("fpga_%i_packets", i));
-        gROOT->Add(received_packet_graphs[i]);
-        received_packet_graphs[i]->SetTitle(Form("FPGA %i Packets", i));
-        received_packet_graphs[i]->GetXaxis()->SetTitle("Time");
-        received_packet_graphs[i]->GetXaxis()->SetTimeDisplay(1);
-        received_packet_graphs[i]->GetXaxis()->SetTimeFormat("%H:%M:%S");
-        received_packet_graphs[i]->GetYaxis()->SetTitle("Packets");
-        received_packet_graphs[i]->SetLineColor(kBlue);
-        received_packet_graphs[i]->SetLineWidth(2);
-        received_packet_graphs[i]->Draw("AL");
-        legend->AddEntry(received_packet_graphs[i], "Received Packets", "l");
-        first_packet[i] = true;
-
-        missed_packet_graphs[i] = new TGraph();
-        missed_packet_graphs[i]->SetName(Form("fpga_%i_missed_packets", i));
-        gROOT->Add(missed_packet_graphs[i]);
-        missed_packet_graphs[i]->SetTitle(Form("FPGA %i Missed Packets", i));
-        missed_packet_graphs[i]->GetXaxis()->SetTitle("Time");
-        missed_packet_graphs[i]->GetXaxis()->SetTimeDisplay(1);
-        missed_packet_graphs[i]->GetXaxis()->SetTimeFormat("%H:%M:%S");
-        missed_packet_graphs[i]->GetYaxis()->SetTitle("Missed Packets");
-        missed_packet_graphs[i]->SetLineColor(kRed);
-        missed_packet_graphs[i]->SetLineWidth(2);
-        legend->AddEntry(missed_packet_graphs[i], "Missed Packets", "l");
-        missed_packet_graphs[i]->Draw("L");
-
-        legend->Draw();
-
-        missed_packet_graphs_percent[i] = new TGraph();
-        missed_packet_graphs_percent[i]->SetName(Form("fpga_%i_missed_packets_percent", i));
-        gROOT->Add(missed_packet_graphs_percent[i]);
-        missed_packet_graphs_percent[i]->SetTitle(Form("FPGA %i Missed Packets Percent", i));
-        missed_packet_graphs_percent[i]->GetXaxis()->SetTitle("Time");
-        missed_packet_graphs_percent[i]->GetXaxis()->SetTimeDisplay(1);
-        missed_packet_graphs_percent[i]->GetXaxis()->SetTimeFormat("%H:%M:%S");
-        missed_packet_graphs_percent[i]->GetYaxis()->SetTitle("Missed Packets Percent");
-        missed_packet_graphs_percent[i]->SetLineColor(kGreen+2);
-        missed_packet_graphs_percent[i]->SetLineWidth(2);
-        legend->AddEntry(missed_packet_graphs_percent[i], "Missed Packets Percent", "l");
-        missed_packet_graphs_percent[i]->Draw("LY+");
+    index = nullptr;
+    inotify_fd = -1;
+    backoff_ms = 1;
+    if (!open_run(fname)) {
+        throw std::runtime_error("Error opening file");
     }
+}
 
+
+//********************************************************************************************
+// Opening runs and their segments
+//********************************************************************************************
+bool file_stream::open_run(const char *fname) {
+    run_name = fname;
+    if (run_name.size() > 4 && run_name.compare(run_name.size() - 4, 4, ".h2g") == 0) {
+        run_name.erase(run_name.size() - 4);
+    }
+    reset_counters();
+    return open_segment(0);
+}
+
+std::string file_stream::segment_name(int segment) {
+    if (segment == 0) {
+        return run_name + ".h2g";
+    }
+    return run_name + "_" + std::to_string(segment) + ".h2g";
+}
+
+bool file_stream::has_next_segment() {
+    return !gSystem->AccessPathName(segment_name(segment + 1).c_str());
+}
+
+bool file_stream::next_segment() {
+    if (!has_next_segment()) {
+        return false;
+    }
+    // The DAQ only starts a new segment once the last one is finished, so nothing is left behind
+    return open_segment(segment + 1);
+}
+
+void file_stream::close_file() {
+    if (file.is_open()) {
+        file.close();
+    }
+#ifdef __linux__
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+#endif
+    inotify_fd = -1;
+    if (index != nullptr) {
+        index->save();
+        delete index;
+        index = nullptr;
+    }
+}
+
+bool file_stream::open_segment(int segment) {
+    close_file();
+    this->segment = segment;
+    auto fname = segment_name(segment);
     std::cout << "Attempting to open file " << fname << std::endl;
     file = std::ifstream(fname, std::ios::in | std::ios::binary);
     if (!file.good()) {
         std::cerr << "Error opening file" << std::endl;
-        throw std::runtime_error("Error opening file");
+        return false;
     }
-    //********************************************************************************************
-    // read file until newline is found
-    //********************************************************************************************
-    char c;
-    //********************************************************************************************
-    // First part of file contains additional information written by the DAQ regarding settings
-    // This part needs to be skipped, different version contain different number of lines
-    //********************************************************************************************
-    int skipLines = 21;
-    if (configuration::get_instance()->FILE_VERSION_MINOR == 13) 
-      skipLines = 23;
-    if (configuration::get_instance()->FILE_VERSION_MINOR > 13) 
-      skipLines = 25;
-    std::cout << "Skipping first " << skipLines << std::endl;
-    for (int i = 0; i < skipLines; i++) { 
-        while (file.get(c) && c != '\n');
+    // Packets start right after the header, the same parse load_configs did is reused
+    run_header header;
+    if (!read_run_header(fname, header) || !header.complete) {
+        std::cerr << "Could not find the end of the header in " << fname << std::endl;
+        file.close();
+        return false;
     }
-    current_head = file.tellg();
+    data_start = header.data_start;
+    current_head = data_start;
+    file.seekg(current_head, std::ios::beg);
+    file_size = current_head;
     std::cout << "Starting at byte " << current_head << std::endl;
+    index = new packet_index(fname.c_str(), current_head, configuration::get_instance()->PACKET_SIZE, configuration::get_instance()->NUM_FPGA);
+
+    // Get woken up when the DAQ writes to the file instead of polling it
+    backoff_ms = 1;
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, fname.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        perror("inotify_add_watch");
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+#endif
+    if (inotify_fd < 0) {
+        std::cout << "inotify not available, polling the file instead" << std::endl;
+    }
+    return true;
 }
 
 
@@ -114,44 +123,10 @@ file_stream::file_stream(const char *fname) {
 // File stream deletion
 //********************************************************************************************
 file_stream::~file_stream() {
-    file.close();
     print_packet_numbers();
-    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-        delete received_packet_graphs[i];
-        delete missed_packet_graphs[i];
-        delete missed_packet_graphs_percent[i];
-        delete mg[i];
-    }
-    delete[] current_packet;
-    delete[] missed_packets;
-    delete[] total_packets;
-    delete[] canvas_id;
-    delete[] first_packet;
-    delete[] received_packet_graphs;
-    delete[] missed_packet_graphs;
-    delete[] missed_packet_graphs_percent;
-    delete[] mg;
-}
-
-//********************************************************************************************
-// File stream deletion
-//********************************************************************************************
-void file_stream::print_packet_numbers() {
-    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
-        auto time = TDatime();
-        std::cout << "\n===========================================" << std::endl;
-        std::cout << "FPGA " << i << " statistics" << std::endl;
-        std::cout << "Read Nr. "<<  received_packet_graphs[i]->GetN() << " Received total: "<< "\t"<< total_packets[i] << "\t missed total:\t" << missed_packets[i]  << std::endl;
-        std::cout << "===========================================" << std::endl;
-        received_packet_graphs[i]->SetPoint(received_packet_graphs[i]->GetN(), time.Convert(), total_packets[i]);
-        received_packet_graphs[i]->GetYaxis()->SetRangeUser(0, 1.2 * (float)total_packets[i]);
-        missed_packet_graphs[i]->SetPoint(missed_packet_graphs[i]->GetN(), time.Convert(), missed_packets[i]);
-        missed_packet_graphs_percent[i]->SetPoint(missed_packet_graphs_percent[i]->GetN(), time.Convert(), (double)missed_packets[i] / total_packets[i]);
-        missed_packet_graphs_percent[i]->GetYaxis()->SetRangeUser(0, 1);
-    }
+    close_file();
 }
 
-
 //********************************************************************************************
 // Reading single packet
 //********************************************************************************************
@@ -159,12 +134,14 @@ int file_stream::read_packet(uint8_t *buffer) {
     auto config = configuration::get_instance();
     // Check if PACKET_SIZE bytes are available to read
     file.seekg(0, std::ios::end);
+    file_size = file.tellg();
     // std::cout <<current_head << "\t" <<  file.tellg() << "\t" << file.tellg() - current_head << "\t" << config->PACKET_SIZE << std::endl;
-    if (file.tellg() - current_head < config->PACKET_SIZE) {
+    if (file_size - current_head < config->PACKET_SIZE) {
         file.seekg(current_head, std::ios::beg);
         return 0;
     }
     file.seekg(current_head, std::ios::beg);
+    backoff_ms = 1;
     // file.seekg(-1 * PACKET_SIZE, std::ios::cur);
     file.read(reinterpret_cast<char*>(buffer), config->PACKET_SIZE);;
     current_head = file.tellg();
@@ -181,38 +158,172 @@ int file_stream::read_packet(uint8_t *buffer) {
       perror("bad read");
       return 0;
     }
-    // Check if this is a heartbeat packet
-    if (buffer[0] == 0x23 && buffer[1] == 0x23 && buffer[2] == 0x23 && buffer[3] == 0x23) {
-        return 2;
-    }
-    // determine to which fpga this packet belongs
-    uint32_t packet_number = (buffer[2] << 8) + (buffer[3]);    //UDP packet nr. 
-    uint32_t fpga_id = buffer[13];
-  
-// Decompose beginning of each packet    
-//     for (int i = 0; i < 192/8; i++){
-//       for (int j = 0; j < 8; j++){
-//         std::cout << std::hex <<int(buffer[i*8+j]) << "\t" ;
-//       }
-//       std::cout << std::endl;  
-//     }
-//     std::cout << std::dec << std::endl;  
-//     
-    if (config->FILE_VERSION_MINOR > 12) {
-      packet_number = uint32_t(buffer[0]<< 24) + uint32_t(buffer[1]<< 16) + uint32_t(buffer[2]<< 8) + uint32_t(buffer[3]) ;
-      fpga_id = buffer[16] >> 4;
-    }
-    
-    if ((packet_number != (uint32_t)(current_packet[fpga_id] + 1)) && !first_packet[fpga_id]) {
-          std::cout << "Missed or out of order - "<<  "previous counter \t" << (uint32_t)(current_packet[fpga_id]) << "\t current\t" << packet_number << std::endl;
-          total_packets[fpga_id] += packet_number - current_packet[fpga_id] - 1;
-          missed_packets[fpga_id] ++;   
-    } else if (first_packet) {
-        current_packet[fpga_id] = packet_number;
-        first_packet[fpga_id] = false;
-    }
-  
-    total_packets[fpga_id]++;
-    current_packet[fpga_id] = packet_number;
-    return 1;
+    index->add((uint64_t)current_head - config->PACKET_SIZE, buffer);
+    return count_packet(buffer);
+}
+
+
+//********************************************************************************************
+// Checkpointing
+//********************************************************************************************
+static const int counts_fields = sizeof(sequence_counts) / sizeof(uint64_t);
+
+void file_stream::save_state(TDirectory *dir) {
+    auto n = configuration::get_instance()->NUM_FPGA;
+    // The sequence counts of every FPGA back to back, the window itself starts over on restore
+    std::vector<unsigned long long> counts(n * counts_fields);
+    for (int i = 0; i < n; i++) {
+        auto c = trackers[i].get_counts();
+        std::memcpy(&counts[i * counts_fields], &c, sizeof(c));
+    }
+    dir->WriteObject(&counts, "packet_sequence_counts");
+    TParameter<Long64_t> offset("file_offset", (Long64_t)current_head);
+    dir->WriteTObject(&offset);
+    TParameter<int> file_segment("file_segment", segment);
+    dir->WriteTObject(&file_segment);
+    TParameter<Long64_t> header_size("data_start", (Long64_t)data_start);
+    dir->WriteTObject(&header_size);
+}
+
+bool file_stream::restore_state(TDirectory *dir) {
+    auto n = configuration::get_instance()->NUM_FPGA;
+    std::vector<unsigned long long> *counts = nullptr;
+    TParameter<Long64_t> *offset = nullptr;
+    TParameter<int> *file_segment = nullptr;
+    dir->GetObject("packet_sequence_counts", counts);
+    dir->GetObject("file_offset", offset);
+    dir->GetObject("file_segment", file_segment);
+    // Checkpoints from before the sequence tracker don't have the counts, they're reprocessed
+    bool good = counts && offset && counts->size() == (size_t)n * counts_fields;
+    // Checkpoints from before runs were split don't have a segment, they're always in the first one
+    int saved_segment = file_segment != nullptr ? file_segment->GetVal() : 0;
+    if (good && saved_segment != segment) {
+        good = open_segment(saved_segment);
+    }
+    // A different header means the file was rewritten since, the offsets are meaningless
+    TParameter<Long64_t> *header_size = nullptr;
+    dir->GetObject("data_start", header_size);
+    if (good && header_size != nullptr && (uint64_t)header_size->GetVal() != data_start) {
+        std::cerr << "Checkpoint was made for a different header, ignoring it" << std::endl;
+        good = false;
+    }
+    delete header_size;
+    if (good) {
+        for (int i = 0; i < n; i++) {
+            sequence_counts c;
+            std::memcpy(&c, &(*counts)[i * counts_fields], sizeof(c));
+            trackers[i].set_counts(c);
+        }
+        current_head = offset->GetVal();
+        file.clear();
+        file.seekg(current_head, std::ios::beg);
+        std::cout << "Resuming at byte " << current_head << std::endl;
+    }
+    delete counts;
+    delete offset;
+    delete file_segment;
+    return good;
+}
+
+
+//********************************************************************************************
+// Block until the file grows or timeout_ms passes
+// Events queued while we were busy reading make this return right away, so no write is missed
+//********************************************************************************************
+void file_stream::wait_for_data(int timeout_ms) {
+#ifdef __linux__
+    if (inotify_fd >= 0) {
+        struct pollfd pfd = {inotify_fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            // Drain the queue, we only care that something happened
+            char events[4096];
+            while (read(inotify_fd, events, sizeof(events)) > 0);
+        }
+        return;
+    }
+#endif
+    // No inotify, back off from 1 ms up to the timeout while the file stays quiet
+    std::this_thread::sleep_for(std::chrono::milliseconds(std::min(backoff_ms, timeout_ms)));
+    backoff_ms = std::min(2 * backoff_ms, 100);
+}
+
+
+//********************************************************************************************
+// Random access through the packet index
+//********************************************************************************************
+// Index the next chunk of the file without decoding it, returns false once we hit the end
+bool file_stream::extend_index() {
+    auto config = configuration::get_instance();
+    const uint64_t chunk_packets = 1024;
+    uint64_t start = index->get_indexed_until();
+    file.clear();
+    file.seekg(0, std::ios::end);
+    file_size = file.tellg();
+    if ((uint64_t)file_size < start + config->PACKET_SIZE) {
+        return false;
+    }
+    uint64_t available = ((uint64_t)file_size - start) / config->PACKET_SIZE;
+    if (available > chunk_packets) {
+        available = chunk_packets;
+    }
+    std::vector<uint8_t> chunk(available * config->PACKET_SIZE);
+    file.seekg(start, std::ios::beg);
+    file.read(reinterpret_cast<char*>(chunk.data()), available * config->PACKET_SIZE);
+    if (!file.good()) {
+        file.clear();
+        return false;
+    }
+    for (uint64_t i = 0; i < available; i++) {
+        index->add(start + i * config->PACKET_SIZE, chunk.data() + i * config->PACKET_SIZE);
+    }
+    return true;
+}
+
+void file_stream::jump_to(uint64_t offset) {
+    current_head = offset;
+    file.clear();
+    file.seekg(current_head, std::ios::beg);
+    // The jump isn't packet loss, start counting again from the next packet we see
+    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
+        trackers[i].restart();
+    }
+    std::cout << "Jumping to byte " << offset << std::endl;
+}
+
+bool file_stream::seek_to_time(uint32_t seconds) {
+    auto offset = index->find_time(seconds);
+    while (offset < 0 && extend_index()) {
+        offset = index->find_time(seconds);
+    }
+    index->save();
+    if (offset < 0) {
+        std::cerr << "No heartbeat at or after " << seconds << " in this run" << std::endl;
+        return false;
+    }
+    jump_to(offset);
+    return true;
+}
+
+bool file_stream::seek_to_packet(uint32_t fpga_id, uint32_t packet_number) {
+    auto config = configuration::get_instance();
+    while (!index->covers_packet(fpga_id, packet_number) && extend_index());
+    index->save();
+    auto offset = index->find_packet(fpga_id, packet_number);
+    if (offset < 0) {
+        std::cerr << "Packet " << packet_number << " of FPGA " << fpga_id << " is not in this run" << std::endl;
+        return false;
+    }
+    // The index is sparse, walk forward to the exact packet (or the first one after it if it was lost)
+    std::vector<uint8_t> buffer(config->PACKET_SIZE);
+    file.clear();
+    file.seekg(offset, std::ios::beg);
+    while (file.read(reinterpret_cast<char*>(buffer.data()), config->PACKET_SIZE)) {
+        uint32_t number, fpga;
+        if (classify_packet(buffer.data(), number, fpga) == 1 && fpga == fpga_id && number >= packet_number) {
+            break;
+        }
+        offset += config->PACKET_SIZE;
+    }
+    jump_to(offset);
+    return true;
 }
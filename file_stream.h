@@ -1,31 +1,59 @@
 #pragma once
 
 #include "configuration.h"
+#include "packet_index.h"
+#include "packet_stream.h"
 
 #include <TGraph.h>
 #include <TMultiGraph.h>
+#include <TDirectory.h>
 
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <string>
 
-class file_stream {
+// Reads one run at a time.  A run can be split over segments, RunXXX.h2g followed by
+// RunXXX_1.h2g, RunXXX_2.h2g, ..., which are read back to back as if they were one file.
+class file_stream : public packet_stream {
 private:
+    std::string run_name;       // Without the .h2g
+    int segment;
     std::ifstream file;
     std::streampos current_head;
-    uint32_t *current_packet;
-    uint32_t *missed_packets;
-    uint32_t *total_packets;
-    int *canvas_id;
-    bool *first_packet;
-    TGraph **received_packet_graphs;
-    TGraph **missed_packet_graphs;
-    TGraph **missed_packet_graphs_percent;
-    TMultiGraph **mg;
+    uint64_t data_start;        // First packet, from the run header
+    std::streampos file_size;
+    packet_index *index;
+    int inotify_fd;
+    int backoff_ms;
+
+    bool extend_index();
+    void jump_to(uint64_t offset);
+    std::string segment_name(int segment);
+    bool open_segment(int segment);
+    void close_file();
 
 public:
     file_stream(const char *fname);
     ~file_stream();
-    int read_packet(uint8_t *buffer);
-    void print_packet_numbers();
+    // Switch to another run, starting the packet counters over.  The graphs carry on.
+    bool open_run(const char *fname);
+    // Whether the DAQ has started the next segment, it only does once this one is finished
+    bool has_next_segment();
+    // Move on to the next segment of the run if the DAQ has started it
+    bool next_segment();
+    int get_segment() {return segment;}
+    int read_packet(uint8_t *buffer) override;
+    void wait_for_data(int timeout_ms) override;
+    void save_index() {index->save();}
+    // Move the read head, building the index as far as needed.  Return false if the target isn't in the file.
+    bool seek_to_time(uint32_t seconds);
+    bool seek_to_packet(uint32_t fpga_id, uint32_t packet_number);
+    // Packet counters and read position, for checkpoints
+    void save_state(TDirectory *dir);
+    bool restore_state(TDirectory *dir);
+    // Bytes written by the DAQ that we haven't read yet
+    uint64_t get_backlog() override {return file_size > current_head ? (uint64_t)(file_size - current_head) : 0;}
+    // Reads straight from the file, so an empty read is the end of what's been written
+    bool finished() override {return true;}
 };
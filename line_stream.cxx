@@ -115,7 +115,7 @@ void line_stream::decode(int32_t asic_id, int32_t fpga_id, int32_t half_id, uint
             TOT = TOT << 3;
         }
     
-        channels[fpga_id][asic_id][i + 36 * half_id]->construct_event(timestamp, ADC);
+        channels[fpga_id][asic_id][i + 36 * half_id]->construct_event(timestamp, ADC, TOT, TOA);
         channels[fpga_id][asic_id][i + 36 * half_id]->fill_readouts(ADC, TOT, TOA);
     }
 }
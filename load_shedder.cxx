@@ -0,0 +1,91 @@
+#include "load_shedder.h"
+
+#include "configuration.h"
+#include "canvas_manager.h"
+#include "server.h"
+
+#include <TROOT.h>
+#include <TGraph.h>
+#include <TAxis.h>
+#include <TDatime.h>
+
+#include <algorithm>
+#include <iostream>
+
+load_shedder::load_shedder() {
+    prescale = 1;
+    packets_seen = 0;
+    packets_accepted = 0;
+
+    auto canvases = canvas_manager::get_instance();
+    auto s = server::get_instance();
+    auto canvas_id = canvases.new_canvas("Sampling_Fraction", "Decoded Packet Fraction", 1200, 800);
+    s->register_object("/QA Plots/DAQ Performance", canvases.get_canvas(canvas_id));
+
+    sampling_fraction = new TGraph();
+    sampling_fraction->SetName("sampling_fraction");
+    gROOT->Add(sampling_fraction);
+    sampling_series = new timeseries(sampling_fraction, timeseries::MIN);
+    sampling_fraction->SetTitle("Fraction of Packets Decoded");
+    sampling_fraction->GetXaxis()->SetTitle("Time");
+    sampling_fraction->GetXaxis()->SetTimeDisplay(1);
+    sampling_fraction->GetXaxis()->SetTimeFormat("%H:%M:%S");
+    sampling_fraction->GetYaxis()->SetTitle("Decoded Fraction");
+    sampling_fraction->SetLineColor(kBlue);
+    sampling_fraction->SetLineWidth(2);
+    sampling_fraction->Draw("AL");
+    sampling_fraction->GetYaxis()->SetRangeUser(0, 1.1);
+}
+
+load_shedder::~load_shedder() {
+    delete sampling_series;
+    delete sampling_fraction;
+}
+
+bool load_shedder::accept() {
+    auto burst = configuration::get_instance()->LOAD_SHED_BURST;
+    if (burst < 1) {
+        burst = 1;
+    }
+    bool keep = (packets_seen / burst) % prescale == 0;
+    packets_seen++;
+    if (keep) {
+        packets_accepted++;
+    }
+    return keep;
+}
+
+//********************************************************************************************
+// Called once per refresh, doubles or halves the prescale depending on how far behind we are
+//********************************************************************************************
+void load_shedder::update(uint64_t backlog_bytes) {
+    auto config = configuration::get_instance();
+    if (config->LOAD_SHED_BACKLOG_MB <= 0) {
+        return;
+    }
+    uint64_t threshold = (uint64_t)config->LOAD_SHED_BACKLOG_MB << 20;
+    uint32_t old_prescale = prescale;
+    uint32_t max_prescale = config->LOAD_SHED_MAX_PRESCALE;
+    if (backlog_bytes > threshold && prescale < max_prescale) {
+        // The maximum needn't be a power of 2
+        prescale = std::min(prescale * 2, max_prescale);
+    } else if (backlog_bytes < threshold / 2 && prescale > 1) {
+        // Only scale back up once we're well under the threshold so we don't flip every refresh
+        prescale /= 2;
+    }
+
+    if (prescale != old_prescale) {
+        std::cout << "Backlog is " << (backlog_bytes >> 20) << " MB, decoding 1 in " << prescale << " packets" << std::endl;
+        if (prescale > 1) {
+            server::get_instance()->set_status(Form("PRESCALED 1/%u", prescale));
+        } else {
+            server::get_instance()->set_status("");
+        }
+    }
+
+    auto time = TDatime();
+    double fraction = packets_seen > 0 ? (double)packets_accepted / packets_seen : 1;
+    sampling_series->add(time.Convert(), fraction);
+    packets_seen = 0;
+    packets_accepted = 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "timeseries.h"
+
+#include <TGraph.h>
+
+#include <cstdint>
+
+// Decides which packets get fully decoded when the monitor falls behind the DAQ.
+// Packets are always read (and counted) by the file_stream, but once the backlog
+// passes LOAD_SHED_BACKLOG_MB only one burst of LOAD_SHED_BURST packets out of
+// every `prescale` bursts is decoded.  Bursts keep the samples of a machine gun
+// event together so the waveforms that are filled are still complete.
+class load_shedder {
+private:
+    uint32_t prescale;
+    uint64_t packets_seen;
+    uint64_t packets_accepted;
+    TGraph *sampling_fraction;
+    timeseries *sampling_series;    // Shows the lowest fraction of each bucket
+
+public:
+    load_shedder();
+    ~load_shedder();
+
+    bool accept();
+    void update(uint64_t backlog_bytes);
+    uint32_t get_prescale() {return prescale;}
+};
@@ -0,0 +1,138 @@
+#include "mapping.h"
+
+#include "configuration.h"
+
+#include <iostream>
+
+geometry *geometry::instance = nullptr;
+
+int geometry::global_channel(int fpga, int asic, int channel) {
+    auto config = configuration::get_instance();
+    return (fpga * config->NUM_ASIC + asic) * config->NUM_CHANNELS + channel;
+}
+
+void geometry::split(int global, int &fpga, int &asic, int &channel) {
+    auto config = configuration::get_instance();
+    channel = global % config->NUM_CHANNELS;
+    asic = (global / config->NUM_CHANNELS) % config->NUM_ASIC;
+    fpga = global / (config->NUM_CHANNELS * config->NUM_ASIC);
+}
+
+void geometry::add_channel(int global, int cell, int layer, float x, float y) {
+    if (global < 0 || global >= (int)channels.size()) {
+        return;
+    }
+    channels[global] = {cell, layer, x, y};
+}
+
+void geometry::build() {
+    auto config = configuration::get_instance();
+    channels = std::vector<channel_geometry>(config->NUM_FPGA * config->NUM_ASIC * config->NUM_CHANNELS, {-1, 0, 0, 0});
+    quad_channels.clear();
+    parallel_channels.clear();
+
+    if (config->DETECTOR_ID == 1) {
+        switch (config->SETUP_ID) {
+            case 2: build_lfhcal<2>(); break;
+            case 3: build_lfhcal<3>(); break;
+            case 4: build_lfhcal<4>(); break;
+            default: build_lfhcal<1>(); break;
+        }
+    } else if (config->DETECTOR_ID == 2) {
+        build_eeemcal();
+    } else {
+        build_generic();
+    }
+    build_cells();
+    std::cout << "Geometry: " << num_cells << " cells in " << num_layers << " layers of " << num_x << " x " << num_y << std::endl;
+}
+
+// Invert channels into cell_start and cell_channels, keeping the order channels were added in
+// within each cell
+void geometry::build_cells() {
+    cell_start = std::vector<int>(num_cells + 1, 0);
+    for (auto &c : channels) {
+        if (c.cell >= 0) {
+            cell_start[c.cell + 1]++;
+        }
+    }
+    for (int i = 0; i < num_cells; i++) {
+        cell_start[i + 1] += cell_start[i];
+    }
+    cell_channels = std::vector<int>(cell_start.back(), -1);
+    std::vector<int> filled(num_cells, 0);
+    for (auto global : added_order) {
+        int cell = channels[global].cell;
+        cell_channels[cell_start[cell] + filled[cell]++] = global;
+    }
+}
+
+template <int SETUP_ID>
+void geometry::build_lfhcal() {
+    typedef lfhcal_setup<SETUP_ID> setup;
+    auto config = configuration::get_instance();
+    num_cells = 64 * config->NUM_FPGA * config->NUM_ASIC;
+    num_layers = 8 * config->NUM_FPGA * config->NUM_ASIC;
+    num_x = 4;
+    num_y = 2;
+    added_order.clear();
+    for (int fpga = 0; fpga < config->NUM_FPGA; fpga++) {
+        int stack = config->NUM_FPGA == 4 ? lfhcal_fpga_order[fpga] : fpga;
+        for (int asic = 0; asic < config->NUM_ASIC; asic++) {
+            for (int position = 0; position < 64; position++) {
+                int channel = setup::channel_map[position];
+                if (channel < 0 || channel >= config->NUM_CHANNELS) {
+                    continue;
+                }
+                int global = global_channel(fpga, asic, channel);
+                int layer = (stack * config->NUM_ASIC + asic) * 8 + setup::layer(position);
+                add_channel(global, (fpga * config->NUM_ASIC + asic) * 64 + position, layer, setup::x(position), setup::y(position));
+                added_order.push_back(global);
+            }
+        }
+    }
+}
+
+void geometry::build_eeemcal() {
+    auto config = configuration::get_instance();
+    num_cells = 25;
+    num_layers = 1;
+    num_x = 5;
+    num_y = 5;
+    added_order.clear();
+    quad_channels = std::vector<int>(25 * 4, -1);
+    parallel_channels = std::vector<int>(25, -1);
+    for (int crystal = 0; crystal < 25; crystal++) {
+        int fpga = eeemcal_fpga_map[crystal];
+        int asic = eeemcal_asic_map[crystal];
+        int connector = eeemcal_connector_map[crystal];
+        if (fpga >= config->NUM_FPGA || asic >= config->NUM_ASIC) {
+            continue;
+        }
+        // Crystal 0 is the top left
+        float x = crystal % 5;
+        float y = 4 - crystal / 5;
+        for (int sipm = 0; sipm < 16; sipm++) {
+            int global = global_channel(fpga, asic, eeemcal_16i_channel_map[connector][sipm]);
+            add_channel(global, crystal, 0, x, y);
+            added_order.push_back(global);
+        }
+        for (int sipm = 0; sipm < 4; sipm++) {
+            quad_channels[crystal * 4 + sipm] = global_channel(fpga, asic, eeemcal_4x4_channel_map[connector][sipm]);
+        }
+        parallel_channels[crystal] = global_channel(fpga, asic, eeemcal_16p_channel_map[connector]);
+    }
+}
+
+void geometry::build_generic() {
+    auto config = configuration::get_instance();
+    num_cells = channels.size();
+    num_layers = 1;
+    num_x = config->NUM_FPGA * config->NUM_ASIC;
+    num_y = config->NUM_CHANNELS;
+    added_order.clear();
+    for (int global = 0; global < (int)channels.size(); global++) {
+        add_channel(global, global, 0, global / config->NUM_CHANNELS, global % config->NUM_CHANNELS);
+        added_order.push_back(global);
+    }
+}
@@ -1,2 +1,191 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
+//********************************************************************************************
+// Channel maps of the detectors, as wired
+//********************************************************************************************
+
+// LFHCal, position in an ASIC -> readout channel.  Position p is layer p / 8, x p % 4 and
+// y (p % 8) / 4.  The last 8 readout channels aren't connected.
+// 2024 PS T09 TB ordering
+constexpr int lfhcal_channel2024_map[72] = {64, 63, 66, 65, 69, 70, 67, 68,
+                                            54, 55, 56, 57, 61, 60, 59, 58,
+                                            45, 46, 47, 48, 52, 51, 50, 49,
+                                            37, 36, 39, 38, 42, 43, 40, 41,
+                                            34, 33, 32, 31, 27, 28, 29, 30,
+                                            24, 25, 22, 23, 19, 18, 21, 20,
+                                            16, 14, 15, 12,  9, 11, 10, 13,
+                                             7,  6,  5,  4,  0,  1,  2,  3,
+                                            -1, -1, -1, -1, -1, -1, -1, -1};
+
+// 2025 PS T09 TB ordering
+constexpr int lfhcal_channel2025_map[72] = { 7,  6,  5,  4,  0,  1,  2,  3,
+                                            16, 14, 15, 12,  9, 11, 10, 13,
+                                            24, 25, 22, 23, 19, 18, 21, 20,
+                                            34, 33, 32, 31, 27, 28, 29, 30,
+                                            37, 36, 39, 38, 42, 43, 40, 41,
+                                            45, 46, 47, 48, 52, 51, 50, 49,
+                                            54, 55, 56, 57, 61, 60, 59, 58,
+                                            64, 63, 66, 65, 69, 70, 67, 68,
+                                            -1, -1, -1, -1, -1, -1, -1, -1};
+
+// 2026 TB ordering summing board V1
+constexpr int lfhcal_channel2026SumV1_map[72] = { 56, 11, 16, 18, 32, 5, 13, 22,    // layer 0
+                                                  63, 27, 23, 14, 46, 29, 25, 19,    // layer 1
+                                                  61, 60, 59, 20, 1, 10, 58, 12,     // layer 2
+                                                  15, 30, 65, 34, 33, 57, 64, 69,    // layer 3
+                                                  55, 28, 39, 70, 31, 9, 47, 42,     // layer 4
+                                                  50, 45, 4, 66, 51, 36, 49, 0,      // layer 5
+                                                  3, 7, 41, 54, 24, 37, 43, 68,      // layer 6
+                                                  48, 6, 21, 40, 67, 52, 2, 38,      // layer 7
+                                                  -1, -1, -1, -1, -1, -1, -1, -1};
+
+// 2026 TB ordering summing board V2
+constexpr int lfhcal_channel2026SumV2_map[72] = { 56, 11, 16, 18, 32, 5, 13, 22,    // layer 0
+                                                  63, 27, 23, 14, 46, 29, 25, 19,    // layer 1
+                                                  61, 60, 59, 20, 1, 10, 58, 12,     // layer 2
+                                                  48, 6, 21, 40, 67, 52, 2, 38,      // layer 3
+                                                  15, 30, 65, 34, 33, 57, 64, 69,    // layer 4
+                                                  55, 28, 39, 70, 31, 9, 47, 42,     // layer 5
+                                                  50, 45, 4, 66, 51, 36, 49, 0,      // layer 6
+                                                  3, 7, 41, 54, 24, 37, 43, 68,      // layer 7
+                                                  -1, -1, -1, -1, -1, -1, -1, -1};
+
+// Position of each FPGA in the LFHCal stack, for the 4 FPGA setups
+constexpr int lfhcal_fpga_order[4] = {1, 3, 0, 2};
+
+// EEEMCal mapping - instead of "layers", we have a single plane, where each crystal is one connector
+// FPGA IP | ID
+// 208     | 0
+// 209     | 1
+// 210     | 2
+// 211     | 3
+constexpr int eeemcal_fpga_map[25] = {0, 3, 3, 0, 3,
+                                      2, 1, 1, 1, 2,
+                                      2, 1, 1, 1, 3,
+                                      2, 2, 1, 2, 3,
+                                      2, 0, 0, 1, 2};
+
+// ASIC | ID
+// 0    | 0
+// 1    | 1
+constexpr int eeemcal_asic_map[25] = { 1, 1, 1, 0, 0,
+                                       1, 1, 1, 1, 1,
+                                       1, 0, 0, 0, 0,
+                                       1, 0, 1, 0, 0,
+                                       0, 1, 1, 0, 0};
+
+// Connector | ID
+// A        | 0
+// B        | 1
+// C        | 2
+// D        | 3
+constexpr int eeemcal_connector_map[25] = { 2,  0,  1,  0,  1,
+                                            0,  2,  0,  3,  3,
+                                            1,  2,  0,  3,  0,
+                                            2,  0,  1,  1,  2,
+                                            3,  1,  3,  1,  2};
+
+// Readout channel of each SiPM, per connector
+constexpr int eeemcal_16i_channel_map[4][16] = {{ 2,  6, 11, 15,  0,  4,  9, 13,  1,  5, 10, 14,  3,  7, 12, 16},
+                                                {20, 24, 29, 33, 18, 22, 27, 31, 19, 23, 28, 32, 21, 25, 30, 34},
+                                                {67, 63, 59, 55, 69, 65, 61, 57, 70, 66, 60, 56, 68, 64, 58, 54},
+                                                {50, 46, 40, 36, 52, 48, 42, 38, 51, 47, 43, 39, 49, 45, 41, 37}};
+
+constexpr int eeemcal_4x4_channel_map[4][4] = {{ 0,  4,  9, 12},
+                                               {19, 23, 27, 31},
+                                               {69, 65, 61, 57},
+                                               {52, 48, 42, 38}};
+
+constexpr int eeemcal_16p_channel_map[4] = {6, 25, 63, 46};
+
+//********************************************************************************************
+// Compile time tables for one LFHCal setup, so code built for a fixed SETUP_ID needs no lookups
+//********************************************************************************************
+constexpr const int *lfhcal_setup_channel_map(int setup_id) {
+    switch (setup_id) {
+        case 2: return lfhcal_channel2025_map;
+        case 3: return lfhcal_channel2026SumV1_map;
+        case 4: return lfhcal_channel2026SumV2_map;
+        default: return lfhcal_channel2024_map;
+    }
+}
+
+template <int SETUP_ID>
+struct lfhcal_setup {
+    // Position in the ASIC -> readout channel
+    static constexpr const int *channel_map = lfhcal_setup_channel_map(SETUP_ID);
+
+    static constexpr int layer(int p) {return p / 8;}
+    static constexpr int x(int p) {return p % 4;}
+    static constexpr int y(int p) {return (p % 8) > 3 ? 1 : 0;}
+};
+
+//********************************************************************************************
+// Flat lookup tables from the global channel index ((fpga * NUM_ASIC + asic) * NUM_CHANNELS + channel)
+// to the detector cell, and back.  Built once when the config is loaded.
+// LFHCal cells are tiles, (fpga * NUM_ASIC + asic) * 64 + position, with one channel each.
+// EEEMCal cells are the 25 crystals, with their 16 SiPM channels in connector order.
+// Other detectors get one cell per channel.
+//********************************************************************************************
+struct alignas(16) channel_geometry {
+    int32_t cell;       // -1 if the channel isn't connected
+    int32_t layer;      // Along the beam, 0 for single layer detectors
+    float x;            // In units of cells
+    float y;
+};
+
+class geometry {
+private:
+    geometry() {};
+    geometry(const geometry&) = delete;
+    geometry& operator=(const geometry&) = delete;
+
+    static geometry *instance;
+
+    int num_cells;
+    int num_layers;
+    int num_x;
+    int num_y;
+    std::vector<channel_geometry> channels;     // [global channel]
+    std::vector<int> cell_start;                // [cell], cell_channels index of its first channel, num_cells + 1 long
+    std::vector<int> cell_channels;             // Global channels, grouped by cell
+    // EEEMCal reduced readouts, [crystal * 4 + sipm] and [crystal]
+    std::vector<int> quad_channels;
+    std::vector<int> parallel_channels;
+    std::vector<int> added_order;               // Only used while building
+
+    void add_channel(int global, int cell, int layer, float x, float y);
+    void build_cells();
+    template <int SETUP_ID> void build_lfhcal();
+    void build_eeemcal();
+    void build_generic();
+
+public:
+    static geometry* get_instance() {
+        if (instance == nullptr) {
+            instance = new geometry();
+        }
+        return instance;
+    }
+
+    // Called by load_configs once the detector and channel counts are known
+    void build();
+
+    static int global_channel(int fpga, int asic, int channel);
+    static void split(int global, int &fpga, int &asic, int &channel);
+
+    const channel_geometry &get(int global) {return channels[global];}
+    int get_num_channels() {return channels.size();}
+    int get_num_cells() {return num_cells;}
+    int get_num_layers() {return num_layers;}
+    int get_num_x() {return num_x;}
+    int get_num_y() {return num_y;}
+    int get_cell_size(int cell) {return cell_start[cell + 1] - cell_start[cell];}
+    // n-th channel of a cell, -1 if the cell doesn't have that many
+    int get_cell_channel(int cell, int n) {return n < get_cell_size(cell) ? cell_channels[cell_start[cell] + n] : -1;}
+    int get_quad_channel(int crystal, int sipm) {return quad_channels[crystal * 4 + sipm];}
+    int get_parallel_channel(int crystal) {return parallel_channels[crystal];}
+};
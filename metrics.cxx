@@ -0,0 +1,86 @@
+#include "metrics.h"
+
+#include <iomanip>
+#include <sstream>
+
+metrics *metrics::instance = nullptr;
+
+metrics::metrics() {
+    for (int i = 0; i < MAX_FPGA; i++) {
+        packets_read[i] = 0;
+        packets_missing[i] = 0;
+        packets_late[i] = 0;
+        packets_duplicate[i] = 0;
+        events_attempted[i] = 0;
+        events_complete[i] = 0;
+        events_dropped[i] = 0;
+        events_overflow[i] = 0;
+    }
+    heartbeats = 0;
+    events_aligned = 0;
+    backlog_bytes = 0;
+    prescale = 1;
+    hot_channels = 0;
+    dead_channels = 0;
+    for (int i = 0; i < NUM_STAGES; i++) {
+        stage_nanoseconds[i] = 0;
+        stage_calls[i] = 0;
+    }
+}
+
+//********************************************************************************************
+// OpenMetrics text exposition, a few hundred bytes per FPGA
+//********************************************************************************************
+static void family(std::ostringstream &out, const char *name, const char *type, const char *help) {
+    out << "# TYPE " << name << " " << type << "\n# HELP " << name << " " << help << "\n";
+}
+
+static void per_fpga(std::ostringstream &out, const char *name, std::atomic<uint64_t> *counter, int num_fpga) {
+    for (int i = 0; i < num_fpga && i < metrics::MAX_FPGA; i++) {
+        out << name << "_total{fpga=\"" << i << "\"} " << counter[i].load(std::memory_order_relaxed) << "\n";
+    }
+}
+
+std::string metrics::render(int num_fpga) {
+    static const char *stage_names[NUM_STAGES] = {"read", "decode", "build", "refresh", "checkpoint"};
+    std::ostringstream out;
+    family(out, "h2g_packets_read", "counter", "Data packets read.");
+    per_fpga(out, "h2g_packets_read", packets_read, num_fpga);
+    family(out, "h2g_packets_missing", "counter", "Packets missing from the packet number sequence.");
+    per_fpga(out, "h2g_packets_missing", packets_missing, num_fpga);
+    family(out, "h2g_packets_late", "counter", "Packets that arrived after a higher packet number.");
+    per_fpga(out, "h2g_packets_late", packets_late, num_fpga);
+    family(out, "h2g_packets_duplicate", "counter", "Packets whose packet number was already seen.");
+    per_fpga(out, "h2g_packets_duplicate", packets_duplicate, num_fpga);
+    family(out, "h2g_heartbeats", "counter", "Heartbeat packets read.");
+    out << "h2g_heartbeats_total " << heartbeats.load(std::memory_order_relaxed) << "\n";
+    family(out, "h2g_events_attempted", "counter", "Events started by the per FPGA event builder.");
+    per_fpga(out, "h2g_events_attempted", events_attempted, num_fpga);
+    family(out, "h2g_events_complete", "counter", "Events with every channel.");
+    per_fpga(out, "h2g_events_complete", events_complete, num_fpga);
+    family(out, "h2g_events_dropped", "counter", "Events dropped incomplete.");
+    per_fpga(out, "h2g_events_dropped", events_dropped, num_fpga);
+    family(out, "h2g_events_overflow", "counter", "Complete events discarded because the buffer was full before they were aligned.");
+    per_fpga(out, "h2g_events_overflow", events_overflow, num_fpga);
+    family(out, "h2g_events_aligned", "counter", "Events aligned across all FPGAs.");
+    out << "h2g_events_aligned_total " << events_aligned.load(std::memory_order_relaxed) << "\n";
+    family(out, "h2g_backlog_bytes", "gauge", "Bytes waiting to be read, at the last refresh.");
+    out << "h2g_backlog_bytes " << backlog_bytes.load(std::memory_order_relaxed) << "\n";
+    family(out, "h2g_prescale", "gauge", "Load shedding prescale, 1 if every packet is decoded.");
+    out << "h2g_prescale " << prescale.load(std::memory_order_relaxed) << "\n";
+    family(out, "h2g_hot_channels", "gauge", "Channels far above the median occupancy, at the last refresh.");
+    out << "h2g_hot_channels " << hot_channels.load(std::memory_order_relaxed) << "\n";
+    family(out, "h2g_dead_channels", "gauge", "Channels far below the median occupancy, at the last refresh.");
+    out << "h2g_dead_channels " << dead_channels.load(std::memory_order_relaxed) << "\n";
+    family(out, "h2g_stage_seconds", "counter", "Time spent in each pipeline stage.");
+    for (int i = 0; i < NUM_STAGES; i++) {
+        // Full precision, the default 6 digits would only move in whole seconds past 1000 s
+        out << "h2g_stage_seconds_total{stage=\"" << stage_names[i] << "\"} " << std::setprecision(17) << stage_nanoseconds[i].load(std::memory_order_relaxed) * 1e-9 << "\n";
+    }
+    family(out, "h2g_stage_calls", "counter", "Times each pipeline stage ran.");
+    for (int i = 0; i < NUM_STAGES; i++) {
+        out << "h2g_stage_calls_total{stage=\"" << stage_names[i] << "\"} " << stage_calls[i].load(std::memory_order_relaxed) << "\n";
+    }
+    out << "# EOF\n";
+    return out.str();
+}
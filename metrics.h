@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Counters for scrapers, served as OpenMetrics text at /metrics on the monitor's web server.
+// They are plain atomics bumped where the work happens, so reading them never touches a
+// ROOT object.  Counters only go up, for the life of the process, also across runs.
+class metrics {
+private:
+    metrics();
+    metrics(const metrics&) = delete;
+    metrics& operator=(const metrics&) = delete;
+
+    static metrics *instance;
+
+public:
+    static constexpr int MAX_FPGA = 16;
+    enum stage {READ, DECODE, BUILD, REFRESH, CHECKPOINT, NUM_STAGES};
+
+    static metrics* get_instance() {
+        if (instance == nullptr) {
+            instance = new metrics();
+        }
+        return instance;
+    }
+
+    std::atomic<uint64_t> packets_read[MAX_FPGA];
+    std::atomic<uint64_t> packets_missing[MAX_FPGA];    // Never arrived, counted once the sequence window has moved past them
+    std::atomic<uint64_t> packets_late[MAX_FPGA];
+    std::atomic<uint64_t> packets_duplicate[MAX_FPGA];
+    std::atomic<uint64_t> heartbeats;
+    std::atomic<uint64_t> events_attempted[MAX_FPGA];
+    std::atomic<uint64_t> events_complete[MAX_FPGA];
+    std::atomic<uint64_t> events_dropped[MAX_FPGA];
+    std::atomic<uint64_t> events_overflow[MAX_FPGA];    // Complete, but the buffer was full before they were aligned
+    std::atomic<uint64_t> events_aligned;
+    std::atomic<uint64_t> backlog_bytes;
+    std::atomic<uint32_t> prescale;
+    std::atomic<uint32_t> hot_channels;
+    std::atomic<uint32_t> dead_channels;
+    std::atomic<uint64_t> stage_nanoseconds[NUM_STAGES];
+    std::atomic<uint64_t> stage_calls[NUM_STAGES];
+
+    static void add(std::atomic<uint64_t> *counter, uint32_t fpga, uint64_t n = 1) {
+        if (fpga < MAX_FPGA) counter[fpga].fetch_add(n, std::memory_order_relaxed);
+    }
+    void add_time(stage s, std::chrono::steady_clock::duration time) {
+        stage_nanoseconds[s].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(), std::memory_order_relaxed);
+        stage_calls[s].fetch_add(1, std::memory_order_relaxed);
+    }
+    std::string render(int num_fpga);
+};
+
+// Adds the time until it goes out of scope to a stage
+class stage_timer {
+private:
+    metrics::stage s;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    stage_timer(metrics::stage s) : s(s), start(std::chrono::steady_clock::now()) {}
+    ~stage_timer() {metrics::get_instance()->add_time(s, std::chrono::steady_clock::now() - start);}
+};
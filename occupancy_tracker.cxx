@@ -0,0 +1,182 @@
+#include "occupancy_tracker.h"
+
+#include "configuration.h"
+#include "canvas_manager.h"
+#include "server.h"
+#include "mapping.h"
+#include "metrics.h"
+
+#include <TH2.h>
+#include <TCanvas.h>
+#include <TPaveText.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+// Channels shown in the lists on the canvas and in the log, the counts are always complete
+static const size_t max_listed = 24;
+
+occupancy_tracker::occupancy_tracker(pedestal_tracker *pedestals, int debug) {
+    auto config = configuration::get_instance();
+    auto geo = geometry::get_instance();
+    this->pedestals = pedestals;
+    this->debug = debug;
+    num_channels = config->NUM_FPGA * config->NUM_ASIC * config->NUM_CHANNELS;
+    threshold = config->OCCUPANCY_THRESHOLD;
+    readouts = std::vector<uint64_t>(num_channels, 0);
+    hits = std::vector<uint64_t>(num_channels, 0);
+    occupied.reserve(num_channels);
+
+    // LFHCal gets a layer vs tile map, everything else is a single plane
+    if (config->DETECTOR_ID == 1) {
+        int tiles = geo->get_num_x() * geo->get_num_y();
+        detector_map = new TH2D("occupancy_detector_map", "Occupancy;Layer;Tile (x + y * columns)", geo->get_num_layers(), 0, geo->get_num_layers(), tiles, 0, tiles);
+    } else {
+        detector_map = new TH2D("occupancy_detector_map", "Occupancy;x;y", geo->get_num_x(), 0, geo->get_num_x(), geo->get_num_y(), 0, geo->get_num_y());
+    }
+    detector_bins = std::vector<int>(num_channels, -1);
+    for (int global = 0; global < num_channels && global < geo->get_num_channels(); global++) {
+        auto &cell = geo->get(global);
+        if (cell.cell < 0) {
+            continue;
+        }
+        if (config->DETECTOR_ID == 1) {
+            detector_bins[global] = detector_map->GetBin(cell.layer + 1, (int)cell.x + (int)cell.y * geo->get_num_x() + 1);
+        } else {
+            detector_bins[global] = detector_map->GetBin((int)cell.x + 1, (int)cell.y + 1);
+        }
+    }
+    bin_sum = std::vector<double>(detector_map->GetNcells(), 0);
+    bin_count = std::vector<int>(detector_map->GetNcells(), 0);
+
+    int columns = config->NUM_ASIC * config->NUM_CHANNELS;
+    channel_map = new TH2D("occupancy_channel_map", "Occupancy;Channel + 72 * ASIC;FPGA", columns, 0, columns, config->NUM_FPGA, 0, config->NUM_FPGA);
+
+    channel_list = new TPaveText(0.02, 0.02, 0.98, 0.98, "NDC");
+    channel_list->SetFillColor(0);
+    channel_list->SetBorderSize(0);
+    channel_list->SetTextAlign(12);
+    channel_list->SetTextFont(42);
+
+    auto canvases = canvas_manager::get_instance();
+    auto s = server::get_instance();
+    s->register_object("/QA Plots/Occupancy", detector_map);
+    s->register_object("/QA Plots/Occupancy", channel_map);
+    int c = canvases.new_canvas("Occupancy", "Channel Occupancy", 1200, 1000);
+    auto canvas = canvases.get_canvas(c);
+    s->register_object("/QA Plots/Occupancy", canvas);
+    canvas->Divide(1, 3);
+    canvas->cd(1);
+    detector_map->Draw("colz");
+    canvas->cd(2);
+    channel_map->Draw("colz");
+    canvas->cd(3);
+    channel_list->Draw();
+}
+
+occupancy_tracker::~occupancy_tracker() {
+    delete detector_map;
+    delete channel_map;
+    delete channel_list;
+}
+
+static std::string channel_name(int global) {
+    int fpga, asic, channel;
+    geometry::split(global, fpga, asic, channel);
+    return "F" + std::to_string(fpga) + " A" + std::to_string(asic) + " C" + std::to_string(channel);
+}
+
+static std::string channel_names(const std::vector<int> &channels) {
+    std::string names;
+    for (size_t i = 0; i < channels.size() && i < max_listed; i++) {
+        names += (i > 0 ? ", " : "") + channel_name(channels[i]);
+    }
+    if (channels.size() > max_listed) {
+        names += ", ...";
+    }
+    return names;
+}
+
+//********************************************************************************************
+// Occupancy of every channel from the counters, then the maps and the hot and dead lists.
+// Channels with too few readouts are left out, they'd only be noise.  Hot and dead are relative
+// to the median of the connected channels, so they follow the beam and trigger rate.
+//********************************************************************************************
+void occupancy_tracker::update() {
+    auto config = configuration::get_instance();
+    uint64_t min_readouts = std::max(config->OCCUPANCY_MIN_READOUTS, 1);
+    std::fill(bin_sum.begin(), bin_sum.end(), 0);
+    std::fill(bin_count.begin(), bin_count.end(), 0);
+    occupied.clear();
+
+    int columns = config->NUM_ASIC * config->NUM_CHANNELS;
+    for (int ch = 0; ch < num_channels; ch++) {
+        if (readouts[ch] < min_readouts) {
+            channel_map->SetBinContent(ch % columns + 1, ch / columns + 1, 0);
+            continue;
+        }
+        double occupancy = (double)hits[ch] / readouts[ch];
+        channel_map->SetBinContent(ch % columns + 1, ch / columns + 1, occupancy);
+        if (detector_bins[ch] >= 0) {
+            bin_sum[detector_bins[ch]] += occupancy;
+            bin_count[detector_bins[ch]]++;
+            occupied.push_back(occupancy);
+        }
+    }
+    for (size_t bin = 0; bin < bin_sum.size(); bin++) {
+        detector_map->SetBinContent(bin, bin_count[bin] > 0 ? bin_sum[bin] / bin_count[bin] : 0);
+    }
+
+    hot.clear();
+    dead.clear();
+    double median = 0;
+    if (!occupied.empty()) {
+        std::nth_element(occupied.begin(), occupied.begin() + occupied.size() / 2, occupied.end());
+        median = occupied[occupied.size() / 2];
+        // With no beam the median is 0, then more than one hit per OCCUPANCY_MIN_READOUTS is noisy
+        double hot_above = std::max(config->OCCUPANCY_HOT_FACTOR * median, 1.0 / min_readouts);
+        double dead_below = config->OCCUPANCY_DEAD_PERCENT / 100. * median;
+        for (int ch = 0; ch < num_channels; ch++) {
+            if (readouts[ch] < min_readouts || detector_bins[ch] < 0) {
+                continue;
+            }
+            double occupancy = (double)hits[ch] / readouts[ch];
+            if (occupancy > hot_above) {
+                hot.push_back(ch);
+            } else if (median > 0 && occupancy < dead_below) {
+                dead.push_back(ch);
+            }
+        }
+    }
+
+    auto hot_names = channel_names(hot);
+    auto dead_names = channel_names(dead);
+    channel_list->Clear();
+    channel_list->AddText(Form("Median occupancy %.3g of %zu channels", median, occupied.size()));
+    channel_list->AddText(Form("Hot (%zu): %s", hot.size(), hot_names.c_str()));
+    channel_list->AddText(Form("Dead (%zu): %s", dead.size(), dead_names.c_str()));
+    if (debug > 0) {
+        std::cout << "Occupancy median " << median << ", " << hot.size() << " hot channels";
+        if (!hot.empty()) {
+            std::cout << " (" << hot_names << ")";
+        }
+        std::cout << ", " << dead.size() << " dead channels";
+        if (!dead.empty()) {
+            std::cout << " (" << dead_names << ")";
+        }
+        std::cout << std::endl;
+    }
+
+    auto counters = metrics::get_instance();
+    counters->hot_channels = hot.size();
+    counters->dead_channels = dead.size();
+}
+
+void occupancy_tracker::reset() {
+    threshold = configuration::get_instance()->OCCUPANCY_THRESHOLD;
+    std::fill(readouts.begin(), readouts.end(), 0);
+    std::fill(hits.begin(), hits.end(), 0);
+    hot.clear();
+    dead.clear();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "pedestal_tracker.h"
+
+#include <TH2.h>
+#include <TPaveText.h>
+
+#include <cstdint>
+#include <vector>
+
+// Hits above threshold for every channel (by geometry::global_channel), counted as the readouts
+// are filled.  Once per refresh the counters are turned into occupancy maps, by detector cell and
+// by FPGA/ASIC/channel, and into lists of hot and dead channels compared to the median channel.
+// The refresh is one pass over the flat counters, the histograms are never read back.
+class occupancy_tracker {
+private:
+    int num_channels;
+    double threshold;
+    int debug;
+    pedestal_tracker *pedestals;
+
+    std::vector<uint64_t> readouts;     // [global channel], once the pedestal has settled
+    std::vector<uint64_t> hits;
+    std::vector<double> occupied;       // Scratch for the median
+
+    TH2 *detector_map;                  // Mean occupancy of the channels in each bin
+    std::vector<int> detector_bins;     // [global channel], bin in detector_map or -1
+    std::vector<double> bin_sum;        // [bin]
+    std::vector<int> bin_count;
+    TH2 *channel_map;                   // Channel + 72 * ASIC vs FPGA
+    TPaveText *channel_list;
+
+    std::vector<int> hot;               // Global channels
+    std::vector<int> dead;
+
+public:
+    occupancy_tracker(pedestal_tracker *pedestals, int debug = 0);
+    ~occupancy_tracker();
+
+    // Called for every readout, so kept to two lookups and an add
+    void fill(int global_channel, uint32_t adc, uint32_t tot) {
+        // Wait until we have a decent pedestal, same as zero suppression
+        if (pedestals->get_count(global_channel) < 100) {
+            return;
+        }
+        readouts[global_channel]++;
+        if (tot > 0 || adc > pedestals->get_pedestal(global_channel) + threshold) {
+            hits[global_channel]++;
+        }
+    }
+
+    void update();
+    void reset();
+    const std::vector<int> &get_hot() {return hot;}
+    const std::vector<int> &get_dead() {return dead;}
+};
@@ -2,153 +2,51 @@
 
 #include "server.h"
 #include "decoders.h"
+#include "mapping.h"
+#include "metrics.h"
 
 #include <TROOT.h>
 #include <TCanvas.h>
 #include <TH1.h>
 #include <TH2.h>
+#include <TH3.h>
 #include <TLatex.h>
+#include <TMemFile.h>
 #include <TParameter.h>
+#include <TTree.h>
 
-int lfhcal_channel_map[72];
-// 2024 PS T09 TB ordering
-int lfhcal_channel2024_map[72] = {64, 63, 66, 65, 69, 70, 67, 68,
-                                  54, 55, 56, 57, 61, 60, 59, 58,
-                                  45, 46, 47, 48, 52, 51, 50, 49,
-                                  37, 36, 39, 38, 42, 43, 40, 41,
-                                  34, 33, 32, 31, 27, 28, 29, 30,
-                                  24, 25, 22, 23, 19, 18, 21, 20,
-                                  16, 14, 15, 12,  9, 11, 10, 13,
-                                    7,  6,  5,  4,  0,  1,  2,  3,
-                                    -1, -1, -1, -1, -1, -1, -1, -1};
-
-// 2025 PS T09 TB ordering
-int lfhcal_channel2025_map[72] = { 7,  6,  5,  4,  0,  1,  2,  3,
-                                  16, 14, 15, 12,  9, 11, 10, 13,
-                                  24, 25, 22, 23, 19, 18, 21, 20,
-                                  34, 33, 32, 31, 27, 28, 29, 30,
-                                  37, 36, 39, 38, 42, 43, 40, 41,
-                                  45, 46, 47, 48, 52, 51, 50, 49,
-                                  54, 55, 56, 57, 61, 60, 59, 58,
-                                  64, 63, 66, 65, 69, 70, 67, 68,
-                                  -1, -1, -1, -1, -1, -1, -1, -1};
-
-// 2026 TB ordering summing board V1
-int lfhcal_channel2026SumV1_map[72] = { 56, 11, 16, 18, 32, 5, 13, 22,    // layer 0 
-                                        63, 27, 23, 14, 46, 29, 25, 19,    // layer 1 
-                                        61, 60, 59, 20, 1, 10, 58, 12,     // layer 2
-                                        15, 30, 65, 34, 33, 57, 64, 69,    // layer 3
-                                        55, 28, 39, 70, 31, 9, 47, 42,     // layer 4
-                                        50, 45, 4, 66, 51, 36, 49, 0,      // layer 5 
-                                        3, 7, 41, 54, 24, 37, 43, 68,      // layer 6 
-                                        48, 6, 21, 40, 67, 52, 2, 38,      // layer 7   
-                                          -1, -1, -1, -1, -1, -1, -1, -1};
-
-// 2026 TB ordering summing board V2
-int lfhcal_channel2026SumV2_map[72] = { 56, 11, 16, 18, 32, 5, 13, 22,    // layer 0 
-                                        63, 27, 23, 14, 46, 29, 25, 19,    // layer 1 
-                                        61, 60, 59, 20, 1, 10, 58, 12,     // layer 2
-                                        48, 6, 21, 40, 67, 52, 2, 38,      // layer 3   
-                                        15, 30, 65, 34, 33, 57, 64, 69,    // layer 4
-                                        55, 28, 39, 70, 31, 9, 47, 42,     // layer 5
-                                        50, 45, 4, 66, 51, 36, 49, 0,      // layer 6 
-                                        3, 7, 41, 54, 24, 37, 43, 68,      // layer 7 
-                                          -1, -1, -1, -1, -1, -1, -1, -1};
-                        
-
-// EEEMCal mapping - instead of "layers", we have a single plane, where each crystal is one connector
-// FPGA IP | ID
-// 208     | 0
-// 209     | 1
-// 210     | 2
-// 211     | 3
-int eeemcal_fpga_map[25] = {0, 3, 3, 0, 3,
-                            2, 1, 1, 1, 2,
-                            2, 1, 1, 1, 3,
-                            2, 2, 1, 2, 3,
-                            2, 0, 0, 1, 2};
-
-// ASIC | ID
-// 0    | 0
-// 1    | 1
-int eeemcal_asic_map[25] = { 1, 1, 1, 0, 0,
-                             1, 1, 1, 1, 1,
-                             1, 0, 0, 0, 0,
-                             1, 0, 1, 0, 0,
-                             0, 1, 1, 0, 0};
-
-// Connector | ID
-// A        | 0
-// B        | 1
-// C        | 2
-// D        | 3
-int eeemcal_connector_map[25] = { 2,  0,  1,  0,  1,
-                                  0,  2,  0,  3,  3,
-                                  1,  2,  0,  3,  0,
-                                  2,  0,  1,  1,  2,
-                                  3,  1,  3,  1,  2};
-
-int eeemcal_16i_channel_a_map[16] = { 2,  6, 11, 15,  0,  4,  9, 13,
-                                      1,  5, 10, 14,  3,  7, 12, 16};
-  
-int eeemcal_16i_channel_b_map[16] = {20, 24, 29, 33, 18, 22, 27, 31,
-                                     19, 23, 28, 32, 21, 25, 30, 34};
-  
-int eeemcal_16i_channel_c_map[16] = {67, 63, 59, 55, 69, 65, 61, 57,
-                                     70, 66, 60, 56, 68, 64, 58, 54};
-                                       
-int eeemcal_16i_channel_d_map[16] = {50, 46, 40, 36, 52, 48, 42, 38,
-                                     51, 47, 43, 39, 49, 45, 41, 37};
-
-int *eeemcal_16i_channel_map[4] = {eeemcal_16i_channel_a_map, eeemcal_16i_channel_b_map, eeemcal_16i_channel_c_map, eeemcal_16i_channel_d_map};
-
-int eeemcal_4x4_channel_a_map[4] = {0, 4, 9, 12};
-int eeemcal_4x4_channel_b_map[4] = {19, 23, 27, 31};
-int eeemcal_4x4_channel_c_map[4] = {69, 65, 61, 57};
-int eeemcal_4x4_channel_d_map[4] = {52, 48, 42, 38};
-int *eeemcal_4x4_channel_map[4] = {eeemcal_4x4_channel_a_map, eeemcal_4x4_channel_b_map, eeemcal_4x4_channel_c_map, eeemcal_4x4_channel_d_map};
-
-int eeemcal_16p_channel_map[4] = {6, 25, 63, 46};
-
-
-int lfhcal_get_channel_x(int channel) {
-    return channel % 4;
-}
-
-int lfhcal_get_channel_y(int channel) {
-    return (channel % 8) > 3 ? 1 : 0;
-}
-
-int lfhcal_get_channel_z(int channel) {
-    return channel / 8;
-} 
-
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
 
 online_monitor::online_monitor(int run_number, int debug) {
     gSystem->mkdir("monitoring_plots", kTRUE);
     gSystem->mkdir(Form("monitoring_plots/run_%03d", run_number), kTRUE);
     auto time = std::chrono::system_clock::now();
     timestamp = std::chrono::system_clock::to_time_t(time);
-    output = new TFile(Form("monitoring_plots/run_%03d/run_%03d_monitoring_%d.root", run_number, run_number, timestamp), "RECREATE");
+    output = new TFile(Form("monitoring_plots/run_%03d/run_%03d_monitoring_%d%s.root", run_number, run_number, timestamp, configuration::get_instance()->output_tag().c_str()), "RECREATE");
     
     this->run_number = run_number;
-    auto s = server::get_instance()->get_server();
+    this->debug = debug;
+    auto s = server::get_instance();
 
     canvases = canvas_manager::get_instance();
     auto config = configuration::get_instance();
+    auto geo = geometry::get_instance();
     if (debug > 0) std::cout << "number of ASICs "<< config->NUM_ASIC << "\t number of KCUs: " << config->NUM_FPGA <<std::endl;
     int nCh  = 72*config->NUM_ASIC;
     if (debug > 0) std::cout << "number of channels: " << nCh << std::endl;
     for (int i = 0; i < config->NUM_FPGA; i++) {
-        adc_per_channel.push_back(new TH2D(Form("strip_adc_per_channel_%d", i), Form("Run %03d ADC per Channel FPGA %d", run_number, i), nCh, 0, nCh, 1024, 0, config->MAX_ADC));
-        tot_per_channel.push_back(new TH2D(Form("strip_tot_per_channel_%d", i), Form("Run %03d TOT per Channel FPGA %d", run_number, i), nCh, 0, nCh, 1024, 0, config->MAX_TOT));
-        toa_per_channel.push_back(new TH2D(Form("strip_toa_per_channel_%d", i), Form("Run %03d TOA per Channel FPGA %d", run_number, i), nCh, 0, nCh, 1024, 0, config->MAX_TOA));
-        s->Register("/QA Plots/Spectra/adc", adc_per_channel.back());
-        s->Register("/QA Plots/Spectra/tot", tot_per_channel.back());
-        s->Register("/QA Plots/Spectra/toa", toa_per_channel.back());
+        adc_per_channel.push_back(new TH2I(Form("strip_adc_per_channel_%d", i), Form("Run %03d ADC per Channel FPGA %d", run_number, i), nCh, 0, nCh, 1024, 0, config->MAX_ADC));
+        tot_per_channel.push_back(new TH2I(Form("strip_tot_per_channel_%d", i), Form("Run %03d TOT per Channel FPGA %d", run_number, i), nCh, 0, nCh, 1024, 0, config->MAX_TOT));
+        toa_per_channel.push_back(new TH2I(Form("strip_toa_per_channel_%d", i), Form("Run %03d TOA per Channel FPGA %d", run_number, i), nCh, 0, nCh, 1024, 0, config->MAX_TOA));
+        s->register_object("/QA Plots/Spectra/adc", adc_per_channel.back());
+        s->register_object("/QA Plots/Spectra/tot", tot_per_channel.back());
+        s->register_object("/QA Plots/Spectra/toa", toa_per_channel.back());
         int c = canvases.new_canvas(Form("FPGA_%i", i), Form("FPGA %i", i), 1200, 800);
         auto canvas = canvases.get_canvas(c);
-        s->Register("/QA Plots/FPGA Summaries", canvas);
+        s->register_object("/QA Plots/FPGA Summaries", canvas);
 
         canvas->Divide(1, 3, 0, 0);
         canvas->cd(1);
@@ -164,6 +62,17 @@ online_monitor::online_monitor(int run_number, int debug) {
 
 
 
+    pedestals = new pedestal_tracker();
+    occupancy = new occupancy_tracker(pedestals, debug);
+    features = new pulse_features(1024);
+
+    zero_suppression = new TH1D("zero_suppression", Form("Run %03d Zero Suppression;;Channel Events", run_number), 2 * config->NUM_FPGA, 0, 2 * config->NUM_FPGA);
+    for (int i = 0; i < config->NUM_FPGA; i++) {
+        zero_suppression->GetXaxis()->SetBinLabel(2 * i + 1, Form("F%d kept", i));
+        zero_suppression->GetXaxis()->SetBinLabel(2 * i + 2, Form("F%d suppressed", i));
+    }
+    s->register_object("/QA Plots/DAQ Performance", zero_suppression);
+
     for (int fpga = 0; fpga < config->NUM_FPGA; fpga++) {
         line_streams.push_back(std::vector<std::vector<line_stream*>>());
         channels.push_back(std::vector<std::vector<channel_stream*>>());
@@ -175,7 +84,7 @@ online_monitor::online_monitor(int run_number, int debug) {
                 line_streams[fpga][asic].push_back(l);
             }
             for (int channel = 0; channel < 72; channel++) {
-                auto c = new channel_stream(fpga, asic, channel, adc_per_channel[fpga], tot_per_channel[fpga], toa_per_channel[fpga]);
+                auto c = new channel_stream(fpga, asic, channel, adc_per_channel[fpga], tot_per_channel[fpga], toa_per_channel[fpga], pedestals, occupancy);
                 channels[fpga][asic].push_back(c);
             }
         }
@@ -191,11 +100,13 @@ online_monitor::online_monitor(int run_number, int debug) {
     }
 
     // Set up event builders 
+    building_events = config->AGGREGATOR.empty();
     builders = new event_builder*[config->NUM_FPGA];
     for (int i = 0; i < config->NUM_FPGA; i++) {
         builders[i] = new event_builder(decode_fpga(i));
     }
-    thunderdome = new event_thunderdome(builders);
+    thunderdome = new event_thunderdome(builders, debug);
+    reco = new shower_reco(run_number, 256);
 
     auto text = new TLatex();
     text->SetTextSize(0.12);
@@ -211,19 +122,19 @@ online_monitor::online_monitor(int run_number, int debug) {
         for (int j = 0; j < config->NUM_ASIC; j++) {
             adc_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("adc_fpga_%d_asic_%d", i, j), Form("ADC Spectra FPGA %d ASIC %d", i, j), 1200, 800);
             auto c = canvases.get_canvas(adc_canvas[i * config->NUM_ASIC + j]);
-            s->Register("/QA Plots/Spectra/adc", c);
+            s->register_object("/QA Plots/Spectra/adc", c);
             c->Divide(9, 8, 0, 0);
             waveform_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("waveform_fpga_%d_asic_%d", i, j), Form("Waveform FPGA %d ASIC %d", i, j), 1200, 800);
             c = canvases.get_canvas(waveform_canvas[i * config->NUM_ASIC + j]);
-            s->Register("/QA Plots/Waveform", c);
+            s->register_object("/QA Plots/Waveform", c);
             c->Divide(9, 8, 0, 0);
             tot_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("tot_fpga_%d_asic_%d", i, j), Form("TOT Spectra FPGA %d ASIC %d", i, j), 1200, 800);
             c = canvases.get_canvas(tot_canvas[i * config->NUM_ASIC + j]);
-            s->Register("/QA Plots/Spectra/tot", c);
+            s->register_object("/QA Plots/Spectra/tot", c);
             c->Divide(9, 8, 0, 0);
             toa_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("toa_fpga_%d_asic_%d", i, j), Form("TOA Spectra FPGA %d ASIC %d", i, j), 1200, 800);
             c = canvases.get_canvas(toa_canvas[i * config->NUM_ASIC + j]);
-            s->Register("/QA Plots/Spectra/toa", c);
+            s->register_object("/QA Plots/Spectra/toa", c);
             c->Divide(9, 8, 0, 0);
         }
     }
@@ -280,84 +191,75 @@ online_monitor::online_monitor(int run_number, int debug) {
         uint32_t ordered_toa_canvas[config->NUM_FPGA * config->NUM_ASIC];
         uint32_t adc_max_canvas[config->NUM_FPGA * config->NUM_ASIC];
         
-        if (config->SETUP_ID == 1 ){
-          for (int c = 0; c < 72; c++) lfhcal_channel_map[c] = lfhcal_channel2024_map[c];
-        } else if (config->SETUP_ID == 2){
-          for (int c = 0; c < 72; c++) lfhcal_channel_map[c] = lfhcal_channel2025_map[c];
-        } else if (config->SETUP_ID == 3){
-          for (int c = 0; c < 72; c++) lfhcal_channel_map[c] = lfhcal_channel2026SumV1_map[c];
-        } else if (config->SETUP_ID == 4){
-          for (int c = 0; c < 72; c++) lfhcal_channel_map[c] = lfhcal_channel2026SumV2_map[c];
-        } else {  
-          for (int c = 0; c < 72; c++) lfhcal_channel_map[c] = lfhcal_channel2024_map[c];
-        } 
-        
         for (int i = 0; i < config->NUM_FPGA; i++) {
             for (int j = 0; j < config->NUM_ASIC; j++) {
                 ordered_adc_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("ordered_adc_fpga_%d_asic_%d", i, j), Form("ADC Spectra FPGA %d ASIC %d", i, j), 1200, 800);
                 auto c = canvases.get_canvas(ordered_adc_canvas[i * config->NUM_ASIC + j]);
-                s->Register("/LFHCal", c);
+                s->register_object("/LFHCal", c);
                 c->Divide(8, 8, 0, 0);
                 ordered_waveform_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("ordered_waveform_fpga_%d_asic_%d", i, j), Form("Waveform FPGA %d ASIC %d", i, j), 1200, 800);
                 c = canvases.get_canvas(ordered_waveform_canvas[i * config->NUM_ASIC + j]);
-                s->Register("/LFHCal", c);
+                s->register_object("/LFHCal", c);
                 c->Divide(8, 8, 0, 0);
                 adc_max_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("adc_max_fpga_%d_asic_%d", i, j), Form("ADC Max FPGA %d ASIC %d", i, j), 1200, 800);
                 c = canvases.get_canvas(adc_max_canvas[i * config->NUM_ASIC + j]);
-                s->Register("/LFHCal", c);
+                s->register_object("/LFHCal", c);
                 c->Divide(8, 8, 0, 0);
                 ordered_tot_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("ordered_tot_fpga_%d_asic_%d", i, j), Form("TOT Spectra FPGA %d ASIC %d", i, j), 1200, 800);
                 c = canvases.get_canvas(ordered_tot_canvas[i * config->NUM_ASIC + j]);
-                s->Register("/LFHCal", c);
+                s->register_object("/LFHCal", c);
                 c->Divide(8, 8, 0, 0);
                 ordered_toa_canvas[i * config->NUM_ASIC + j] = canvases.new_canvas(Form("ordered_toa_fpga_%d_asic_%d", i, j), Form("TOA Spectra FPGA %d ASIC %d", i, j), 1200, 800);
                 c = canvases.get_canvas(ordered_toa_canvas[i * config->NUM_ASIC + j]);
-                s->Register("/LFHCal", c);
+                s->register_object("/LFHCal", c);
                 c->Divide(8, 8, 0, 0);
             }
         }
         for (int fpga = 0; fpga < config->NUM_FPGA; fpga++) {
             for (int asic = 0; asic < config->NUM_ASIC; asic++) {
-                for (int channel = 0; channel < 64; channel++) {
+                for (int position = 0; position < 64; position++) {
+                    // Tiles are numbered by position in the ASIC, see mapping.h
+                    int f, a, channel;
+                    geometry::split(geo->get_cell_channel((fpga * config->NUM_ASIC + asic) * 64 + position, 0), f, a, channel);
                     auto c = canvases.get_canvas(ordered_adc_canvas[fpga * config->NUM_ASIC + asic]);
-                    c->cd(channel + 1);
-                    channels[fpga][asic][lfhcal_channel_map[channel]]->draw_adc();
+                    c->cd(position + 1);
+                    channels[fpga][asic][channel]->draw_adc();
                     text->SetTextAlign(33);
                     text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
-                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, lfhcal_channel_map[channel]));
+                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, channel));
                     gPad->SetLogy();
                     
                     c = canvases.get_canvas(ordered_waveform_canvas[fpga * config->NUM_ASIC + asic]);
-                    c->cd(channel + 1);
-                    channels[fpga][asic][lfhcal_channel_map[channel]]->draw_waveform();
+                    c->cd(position + 1);
+                    channels[fpga][asic][channel]->draw_waveform();
                     text->SetTextAlign(33);
                     text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
-                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, lfhcal_channel_map[channel]));
+                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, channel));
                     gPad->SetLogz();
 
                     c = canvases.get_canvas(adc_max_canvas[fpga * config->NUM_ASIC + asic]);
-                    c->cd(channel + 1);
-                    channels[fpga][asic][lfhcal_channel_map[channel]]->draw_max();
+                    c->cd(position + 1);
+                    channels[fpga][asic][channel]->draw_max();
                     text->SetTextAlign(33);
                     text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
-                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, lfhcal_channel_map[channel]));
+                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, channel));
                     text->DrawLatexNDC(0.95, 0.69, Form("max(samples) - samples[0]"));
                     gPad->SetLogy();
 
                     c = canvases.get_canvas(ordered_tot_canvas[fpga * config->NUM_ASIC + asic]);
-                    c->cd(channel + 1);
-                    channels[fpga][asic][lfhcal_channel_map[channel]]->draw_tot();
+                    c->cd(position + 1);
+                    channels[fpga][asic][channel]->draw_tot();
                     text->SetTextAlign(33);
                     text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
-                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, lfhcal_channel_map[channel]));
+                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, channel));
                     gPad->SetLogy();
 
                     c = canvases.get_canvas(ordered_toa_canvas[fpga * config->NUM_ASIC + asic]);
-                    c->cd(channel + 1);
-                    channels[fpga][asic][lfhcal_channel_map[channel]]->draw_toa();
+                    c->cd(position + 1);
+                    channels[fpga][asic][channel]->draw_toa();
                     text->SetTextAlign(33);
                     text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
-                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, lfhcal_channel_map[channel]));
+                    text->DrawLatexNDC(0.95, 0.82, Form("F %d, A %d, Ch %d", fpga, asic, channel));
                     gPad->SetLogy();
                 }
             }
@@ -371,7 +273,7 @@ online_monitor::online_monitor(int run_number, int debug) {
         // Let's try to put everything on one canvas....
         uint32_t waveform_mega__canvas = canvases.new_canvas("Waveforms_eeemcal_individual_readout", "Individual Readout", 1200, 800);
         auto c = canvases.get_canvas(waveform_mega__canvas);
-        s->Register("/EEEMCal/16 Individual", c);
+        s->register_object("/EEEMCal/16 Individual", c);
         c->Divide(5, 5, 0.0002, 0.0002);
         for (int i = 0; i < 25; i++) {
             c->cd(i + 1);
@@ -379,9 +281,10 @@ online_monitor::online_monitor(int run_number, int debug) {
             for (int sipm = 0; sipm < 16; sipm++) {
                 c->cd(i + 1);
                 gPad->cd(sipm + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_16i_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_cell_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_waveform();
                 gPad->SetLogz();
             }
@@ -390,13 +293,14 @@ online_monitor::online_monitor(int run_number, int debug) {
         for (int sipm = 0; sipm < 16; sipm++) {
             uint32_t waveform_individual_readout_canvas = canvases.new_canvas(Form("Waveforms_eeemcal_individual_readout_SiPM%d", sipm), "Individual Readout", 1200, 800);
             c = canvases.get_canvas(waveform_individual_readout_canvas);
-            s->Register(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_16i_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_cell_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_waveform();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -408,13 +312,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
             uint32_t adc_individual_readout_canvas = canvases.new_canvas(Form("ADC_eeemcal_individual_readout_SiPM%d", sipm), "Individual Readout", 1200, 800);
             c = canvases.get_canvas(adc_individual_readout_canvas);
-            s->Register(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_16i_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_cell_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_adc();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -426,13 +331,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
             uint32_t tot_individual_readout_canvas = canvases.new_canvas(Form("ToT_eeemcal_individual_readout_SiPM%d", sipm), "Individual Readout", 1200, 800);
             c = canvases.get_canvas(tot_individual_readout_canvas);
-            s->Register(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_16i_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_cell_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_tot();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -444,13 +350,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
             uint32_t toa_individual_readout_canvas = canvases.new_canvas(Form("ToA_eeemcal_individual_readout_SiPM%d", sipm), "Individual Readout", 1200, 800);
             c = canvases.get_canvas(toa_individual_readout_canvas);
-            s->Register(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/16 Individual/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_16i_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_cell_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_toa();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -465,13 +372,14 @@ online_monitor::online_monitor(int run_number, int debug) {
         // 16 in parallel configurations
         uint32_t waveform_parallel_readout_canvas = canvases.new_canvas("Waveforms_eeemcal_parallel_readout", "Parallel Readout", 1200, 800);
         c = canvases.get_canvas(waveform_parallel_readout_canvas);
-        s->Register("/EEEMCal/16 Parallel", c);
+        s->register_object("/EEEMCal/16 Parallel", c);
         c->Divide(5, 5, 0, 0);
         for (int i = 0; i < 25; i++) {
             c->cd(i + 1);
-            int channel_fpga = eeemcal_fpga_map[i];
-            int channel_asic = eeemcal_asic_map[i];
-            int channel_channel = eeemcal_16p_channel_map[eeemcal_connector_map[i]];
+            int global = geo->get_parallel_channel(i);
+            if (global < 0) continue;
+            int channel_fpga, channel_asic, channel_channel;
+            geometry::split(global, channel_fpga, channel_asic, channel_channel);
             channels[channel_fpga][channel_asic][channel_channel]->draw_waveform();
             text->SetTextAlign(33);
             text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -483,13 +391,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
         uint32_t adc_parallel_readout_canvas = canvases.new_canvas("ADC_eeemcal_parallel_readout", "Parallel Readout", 1200, 800);
         c = canvases.get_canvas(adc_parallel_readout_canvas);
-        s->Register("/EEEMCal/16 Parallel", c);
+        s->register_object("/EEEMCal/16 Parallel", c);
         c->Divide(5, 5, 0, 0);
         for (int i = 0; i < 25; i++) {
             c->cd(i + 1);
-            int channel_fpga = eeemcal_fpga_map[i];
-            int channel_asic = eeemcal_asic_map[i];
-            int channel_channel = eeemcal_16p_channel_map[eeemcal_connector_map[i]];
+            int global = geo->get_parallel_channel(i);
+            if (global < 0) continue;
+            int channel_fpga, channel_asic, channel_channel;
+            geometry::split(global, channel_fpga, channel_asic, channel_channel);
             channels[channel_fpga][channel_asic][channel_channel]->draw_adc();
             text->SetTextAlign(33);
             text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -501,13 +410,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
         uint32_t tot_parallel_readout_canvas = canvases.new_canvas("ToT_eeemcal_parallel_readout", "Parallel Readout", 1200, 800);
         c = canvases.get_canvas(tot_parallel_readout_canvas);
-        s->Register("/EEEMCal/16 Parallel", c);
+        s->register_object("/EEEMCal/16 Parallel", c);
         c->Divide(5, 5, 0, 0);
         for (int i = 0; i < 25; i++) {
             c->cd(i + 1);
-            int channel_fpga = eeemcal_fpga_map[i];
-            int channel_asic = eeemcal_asic_map[i];
-            int channel_channel = eeemcal_16p_channel_map[eeemcal_connector_map[i]];
+            int global = geo->get_parallel_channel(i);
+            if (global < 0) continue;
+            int channel_fpga, channel_asic, channel_channel;
+            geometry::split(global, channel_fpga, channel_asic, channel_channel);
             channels[channel_fpga][channel_asic][channel_channel]->draw_tot();
             text->SetTextAlign(33);
             text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -519,13 +429,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
         uint32_t toa_parallel_readout_canvas = canvases.new_canvas("ToA_eeemcal_parallel_readout", "Parallel Readout", 1200, 800);
         c = canvases.get_canvas(toa_parallel_readout_canvas);
-        s->Register("/EEEMCal/16 Parallel", c);
+        s->register_object("/EEEMCal/16 Parallel", c);
         c->Divide(5, 5, 0, 0);
         for (int i = 0; i < 25; i++) {
             c->cd(i + 1);
-            int channel_fpga = eeemcal_fpga_map[i];
-            int channel_asic = eeemcal_asic_map[i];
-            int channel_channel = eeemcal_16p_channel_map[eeemcal_connector_map[i]];
+            int global = geo->get_parallel_channel(i);
+            if (global < 0) continue;
+            int channel_fpga, channel_asic, channel_channel;
+            geometry::split(global, channel_fpga, channel_asic, channel_channel);
             channels[channel_fpga][channel_asic][channel_channel]->draw_toa();
             text->SetTextAlign(33);
             text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -538,7 +449,7 @@ online_monitor::online_monitor(int run_number, int debug) {
         // Set up 4x4 canvases
         waveform_mega__canvas = canvases.new_canvas("realistic_waveforms_eeemcal_4x4_readout_realistic", "4x4 Readout, Actual", 1200, 800);
         c = canvases.get_canvas(waveform_mega__canvas);
-        s->Register("/EEEMCal/4x4 Readout", c);
+        s->register_object("/EEEMCal/4x4 Readout", c);
         c->Divide(5, 5, 0.0002, 0.0002);
         for (int i = 0; i < 25; i++) {
             c->cd(i + 1);
@@ -546,9 +457,10 @@ online_monitor::online_monitor(int run_number, int debug) {
             for (int sipm = 0; sipm < 4; sipm++) {
                 c->cd(i + 1);
                 gPad->cd(sipm + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_4x4_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_quad_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_waveform();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -561,7 +473,7 @@ online_monitor::online_monitor(int run_number, int debug) {
 
         waveform_mega__canvas = canvases.new_canvas("useful_aveforms_eeemcal_4x4_readout", "4x4 Readout, Useful", 1200, 800);
         c = canvases.get_canvas(waveform_mega__canvas);
-        s->Register("/EEEMCal/4x4 Readout", c);
+        s->register_object("/EEEMCal/4x4 Readout", c);
         c->Divide(5, 5, 0.0002, 0.0002);
         for (int i = 0; i < 25; i++) {
             c->cd(i + 1);
@@ -569,9 +481,10 @@ online_monitor::online_monitor(int run_number, int debug) {
             for (int sipm = 0; sipm < 4; sipm++) {
                 c->cd(i + 1);
                 gPad->cd(sipm + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_4x4_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_quad_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_waveform();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -587,13 +500,14 @@ online_monitor::online_monitor(int run_number, int debug) {
         for (int sipm = 0; sipm < 4; sipm++) {
             uint32_t waveform_4x4_readout_canvas = canvases.new_canvas(Form("Waveforms_eeemcal_4x4_readout_SiPM%d", sipm), "4x4 Readout", 1200, 800);
             c = canvases.get_canvas(waveform_4x4_readout_canvas);
-            s->Register(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_4x4_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_quad_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_waveform();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -605,13 +519,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
             uint32_t adc_4x4_readout_canvas = canvases.new_canvas(Form("ADC_eeemcal_4x4_readout_SiPM%d", sipm), "4x4 Readout", 1200, 800);
             c = canvases.get_canvas(adc_4x4_readout_canvas);
-            s->Register(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_4x4_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_quad_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_adc();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -623,13 +538,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
             uint32_t tot_4x4_readout_canvas = canvases.new_canvas(Form("ToT_eeemcal_4x4_readout_SiPM%d", sipm), "4x4 Readout", 1200, 800);
             c = canvases.get_canvas(tot_4x4_readout_canvas);
-            s->Register(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_4x4_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_quad_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_tot();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -641,13 +557,14 @@ online_monitor::online_monitor(int run_number, int debug) {
 
             uint32_t toa_4x4_readout_canvas = canvases.new_canvas(Form("ToA_eeemcal_4x4_readout_SiPM%d", sipm), "4x4 Readout", 1200, 800);
             c = canvases.get_canvas(toa_4x4_readout_canvas);
-            s->Register(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
+            s->register_object(Form("/EEEMCal/4x4 Readout/SiPM %d", sipm), c);
             c->Divide(5, 5, 0, 0);
             for (int i = 0; i < 25; i++) {
                 c->cd(i + 1);
-                int channel_fpga = eeemcal_fpga_map[i];
-                int channel_asic = eeemcal_asic_map[i];
-                int channel_channel = eeemcal_4x4_channel_map[eeemcal_connector_map[i]][sipm];
+                int global = geo->get_quad_channel(i, sipm);
+                if (global < 0) continue;
+                int channel_fpga, channel_asic, channel_channel;
+                geometry::split(global, channel_fpga, channel_asic, channel_channel);
                 channels[channel_fpga][channel_asic][channel_channel]->draw_toa();
                 text->SetTextAlign(33);
                 text->DrawLatexNDC(0.95, 0.95, Form("Run %d", run_number));
@@ -660,25 +577,125 @@ online_monitor::online_monitor(int run_number, int debug) {
 
     }
 
-    // Set up event display
-    // event_drawn = 0;
-    // c = canvases.new_canvas("event_display_canvas", Form("Run %03d Event Display", run_number), 1200, 800);
-    // auto canvas = canvases.get_canvas(c);
-    // event_display = new TH3D("event_display", Form("Run %03d Event Display", run_number), 64, 0, 64, 4, 0, 4, 2, 0, 2);
-    // event_display->Draw("BOX2");
-    // s->Register("/event_display", canvas);
+    //************************************************************************************
+    // Rolling time windows
+    //************************************************************************************
+    if (config->ROLLING_WINDOWS.size() > 0) {
+        for (int i = 0; i < config->NUM_FPGA; i++) {
+            for (int j = 0; j < config->NUM_ASIC; j++) {
+                auto adc_id = canvases.new_canvas(Form("rolling_adc_fpga_%d_asic_%d", i, j), Form("Rolling ADC Spectra FPGA %d ASIC %d", i, j), 1200, 800);
+                auto adc_c = canvases.get_canvas(adc_id);
+                s->register_object("/QA Plots/Rolling", adc_c);
+                adc_c->Divide(9, 8, 0, 0);
+                TCanvas *waveform_c = nullptr;
+                if (config->ROLLING_WAVEFORMS) {
+                    auto waveform_id = canvases.new_canvas(Form("rolling_waveform_fpga_%d_asic_%d", i, j), Form("Rolling Waveform FPGA %d ASIC %d", i, j), 1200, 800);
+                    waveform_c = canvases.get_canvas(waveform_id);
+                    s->register_object("/QA Plots/Rolling", waveform_c);
+                    waveform_c->Divide(9, 8, 0, 0);
+                }
+                for (int channel = 0; channel < 72; channel++) {
+                    adc_c->cd(channel + 1);
+                    channels[i][j][channel]->draw_adc_window();
+                    text->SetTextAlign(33);
+                    text->DrawLatexNDC(0.95, 0.82, Form("FPGA %d", i));
+                    text->DrawLatexNDC(0.95, 0.69, Form("ASIC %d", j));
+                    text->DrawLatexNDC(0.95, 0.56, Form("Channel %d", channel));
+                    gPad->SetLogy();
+                    if (waveform_c == nullptr) {
+                        continue;
+                    }
+                    waveform_c->cd(channel + 1);
+                    channels[i][j][channel]->draw_waveform_window();
+                    text->SetTextAlign(33);
+                    text->DrawLatexNDC(0.95, 0.82, Form("FPGA %d", i));
+                    text->DrawLatexNDC(0.95, 0.69, Form("ASIC %d", j));
+                    text->DrawLatexNDC(0.95, 0.56, Form("Channel %d", channel));
+                    gPad->SetLogz();
+                }
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        window_slice_start = std::vector<std::chrono::steady_clock::time_point>(config->ROLLING_WINDOWS.size(), now);
+
+        // The page picks which window the rolling plots show
+        TParameter<int> *window = new TParameter<int>("rolling_window", 0);
+        gDirectory->GetList()->Add(window);
+        s->register_object("/", window);
+        s->get_server()->Hide("/rolling_window");
+        for (int w = 0; w < config->ROLLING_WINDOWS.size(); w++) {
+            s->get_server()->RegisterCommand(Form("/QA Plots/Rolling/Show_Last_%d_min", config->ROLLING_WINDOWS[w]), Form("/rolling_window/->SetVal(%d);", w));
+        }
+    }
+
+    //************************************************************************************
+    // Recent raw pulses, only drawn once someone picks a channel on the page
+    //************************************************************************************
+    pulse_canvas = nullptr;
+    if (config->WAVEFORM_RING_SIZE > 0) {
+        auto pulse_id = canvases.new_canvas("recent_pulses", "Recent Pulses", 1200, 800);
+        pulse_canvas = canvases.get_canvas(pulse_id);
+        s->register_object("/QA Plots/Pulses", pulse_canvas);
+        for (int i = 0; i < config->WAVEFORM_RING_SIZE; i++) {
+            auto g = new TGraph(config->MAX_SAMPLES);
+            g->SetName(Form("recent_pulse_%d", i));
+            g->SetLineColor(i == 0 ? kRed : kGray + 1);
+            g->SetMarkerColor(i == 0 ? kRed : kGray + 1);
+            g->SetMarkerStyle(20);
+            pulse_graphs.push_back(g);
+        }
+        const char *selection[] = {"pulse_fpga", "pulse_asic", "pulse_channel"};
+        for (auto name : selection) {
+            TParameter<int> *p = new TParameter<int>(name, -1);
+            gDirectory->GetList()->Add(p);
+            s->register_object("/", p);
+            s->get_server()->Hide(Form("/%s", name));
+        }
+        s->get_server()->RegisterCommand("/QA Plots/Pulses/Show_Channel", "/pulse_fpga/->SetVal(%arg1%);/pulse_asic/->SetVal(%arg2%);/pulse_channel/->SetVal(%arg3%);");
+        s->get_server()->RegisterCommand("/QA Plots/Pulses/Hide", "/pulse_fpga/->SetVal(-1);");
+    }
+
+    //************************************************************************************
+    // Event display, the bin of every channel is worked out once here so drawing an event
+    // is just adding up its amplitudes
+    //************************************************************************************
+    event_drawn = 0;
+    event_display_bins = std::vector<int>(config->NUM_FPGA * config->NUM_ASIC * config->NUM_CHANNELS, -1);
+    auto display_id = canvases.new_canvas("event_display_canvas", Form("Run %03d Event Display", run_number), 1200, 800);
+    event_display_canvas = canvases.get_canvas(display_id);
+    s->register_object("/Event Display", event_display_canvas);
+    if (config->DETECTOR_ID == 1) {
+        event_display = new TH3D("event_display", Form("Run %03d Event Display;Layer;x;y", run_number), geo->get_num_layers(), 0, geo->get_num_layers(), geo->get_num_x(), 0, geo->get_num_x(), geo->get_num_y(), 0, geo->get_num_y());
+        event_display->Draw("BOX2");
+    } else {
+        // EEEMCal crystals sum all of their SiPMs, other detectors show one bin per channel
+        event_display = new TH2D("event_display", Form("Run %03d Event Display;x;y", run_number), geo->get_num_x(), 0, geo->get_num_x(), geo->get_num_y(), 0, geo->get_num_y());
+        event_display->Draw("colz");
+    }
+    for (int global = 0; global < geo->get_num_channels(); global++) {
+        auto &cell = geo->get(global);
+        if (cell.cell < 0) {
+            continue;
+        }
+        if (config->DETECTOR_ID == 1) {
+            event_display_bins[global] = event_display->GetBin(cell.layer + 1, (int)cell.x + 1, (int)cell.y + 1);
+        } else {
+            event_display_bins[global] = event_display->GetBin((int)cell.x + 1, (int)cell.y + 1);
+        }
+    }
 
     // Register commands
     TParameter<bool> *reset = new TParameter<bool>("reset", false);
     gDirectory->GetList()->Add(reset);
-    s->Register("/", reset);
-    s->Hide("/reset");
-    s->RegisterCommand("/Clear_Histograms", "/reset/->SetVal(1);");
+    s->register_object("/", reset);
+    s->get_server()->Hide("/reset");
+    s->get_server()->RegisterCommand("/Clear_Histograms", "/reset/->SetVal(1);");
     // s->SetItemField("/Clear_Histograms", "_fastcmd", "true");
     // s->SetItemField('/Clear_Histograms", "hide", "true");')
 }
 
 online_monitor::~online_monitor() {
+    finish_checkpoint();
     server::get_instance()->get_server()->SetTerminate();
     server::get_instance()->kill_server();
     canvases.save_all(run_number, timestamp);
@@ -693,80 +710,165 @@ online_monitor::~online_monitor() {
         builders[i]->update_stats();
     }
     output->Write();
+    // Their histograms are written, take them out before the file would delete them on close
+    delete occupancy;
+    delete pedestals;
     std::cout << "Writing root file..." << std::endl;
     output->Close();
 
 }
 
+//********************************************************************************************
+// Finish the current run like the destructor would, but keep the server, canvases and
+// histograms.  The histograms move to the new run's output file and start over empty.
+//********************************************************************************************
+void online_monitor::start_run(int run_number) {
+    std::cout << "Finishing run " << this->run_number << ", starting run " << run_number << std::endl;
+    build_events();
+    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
+        builders[i]->update_stats();
+    }
+    canvases.save_all(this->run_number, timestamp);
+    output->Write();
+
+    auto previous = output;
+    gSystem->mkdir(Form("monitoring_plots/run_%03d", run_number), kTRUE);
+    timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    output = new TFile(Form("monitoring_plots/run_%03d/run_%03d_monitoring_%d%s.root", run_number, run_number, timestamp, configuration::get_instance()->output_tag().c_str()), "RECREATE");
+    std::string old_title = Form("Run %03d", this->run_number);
+    std::string new_title = Form("Run %03d", run_number);
+    // Moving an object changes the list, so go over a copy
+    std::vector<TObject*> objects;
+    for (auto obj : *previous->GetList()) {
+        objects.push_back(obj);
+    }
+    for (auto obj : objects) {
+        if (obj->InheritsFrom(TH1::Class())) {
+            auto hist = (TH1*)obj;
+            hist->Reset("ICESM");
+            hist->SetDirectory(output);
+            std::string title = hist->GetTitle();
+            auto pos = title.find(old_title);
+            if (pos != std::string::npos) {
+                title.replace(pos, old_title.size(), new_title);
+                hist->SetTitle(title.c_str());
+            }
+        } else if (obj->InheritsFrom(TTree::Class())) {
+            auto tree = (TTree*)obj;
+            tree->Reset();
+            tree->SetDirectory(output);
+        }
+    }
+    previous->Close();
+    delete previous;
+    output->cd();
+
+    this->run_number = run_number;
+    for (auto &fpga_streams : channels) {
+        for (auto &asic_streams : fpga_streams) {
+            for (auto *stream : asic_streams) {
+                stream->start_run();
+            }
+        }
+    }
+    pedestals->reset();
+    occupancy->reset();
+    reco->reset();
+    thunderdome->start_run();
+    event_drawn = thunderdome->get_total_built();
+}
+
 void online_monitor::update_events() {
     for (auto fpga_id : channels) {
         for (auto asic_id : fpga_id) {
             for (auto channel : asic_id) {
                 while (channel->has_events()) {
                     auto event = channel->get_event();
-                    builders[event->get_fpga_id()]->channel_hit(event);
+                    if (!event->is_kept()) {
+                        hand_to_builder(event);
+                        continue;
+                    }
+                    // Kept events are batched for the feature kernel, then passed on to the builders
+                    features->add(event, channel->get_pedestal());
+                    feature_channels.push_back(channel);
+                    if (features->full()) {
+                        process_features();
+                    }
                 }
             }
         }
     }
+    process_features();
+}
+
+void online_monitor::hand_to_builder(single_channel_event *event) {
+    if (!building_events) {
+        delete event;
+        return;
+    }
+    builders[event->get_fpga_id()]->channel_hit(event);
+}
+
+void online_monitor::process_features() {
+    if (features->get_size() == 0) {
+        return;
+    }
+    features->process();
+    for (int i = 0; i < features->get_size(); i++) {
+        feature_channels[i]->fill_features(features->events[i]);
+        hand_to_builder(features->events[i]);
+    }
+    features->clear();
+    feature_channels.clear();
 }
 
 void online_monitor::update_builder_graphs() {
+    if (!building_events) {
+        return;
+    }
     for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
         builders[i]->update_stats();
     }
+    std::cout << "Aligned " << thunderdome->get_total_built() << " events across FPGAs." << std::endl;
+    thunderdome->update_drift();
 }
 
 void online_monitor::build_events() {
-    return;
+    if (!building_events) {
+        return;
+    }
     thunderdome->align_events();
-    std::cout << "Built " << thunderdome->get_num_events() << " events" << std::endl;
+    reco->process(*thunderdome);
     thunderdome->clear_events();
 }
 
+//********************************************************************************************
+// Draw the newest aligned event, if there is one we haven't drawn yet
+//********************************************************************************************
 void online_monitor::make_event_display() {
-    return;
-    // Make sure we actually have completed events...
-    if (thunderdome->get_num_events() == 0) {
-        std::cout << "No events to display" << std::endl;
+    if (thunderdome->get_total_built() == event_drawn) {
         return;
     }
-    // Clear existing event display
+    event_drawn = thunderdome->get_total_built();
+    auto config = configuration::get_instance();
+    int per_fpga = config->NUM_ASIC * config->NUM_CHANNELS;
     event_display->Reset();
-    auto last_event = thunderdome->get_event(event_drawn);
-    std::cout << "\nDrawing event " << event_drawn << std::endl;
-    event_drawn++;
-    // std::cerr << "last event: " << thunderdome->get_num_events() - 1 << std::endl;
-    uint32_t fpga_factors[4] = {1, 3, 0, 2};
-    for (auto event : last_event) {
-        auto fpga = event.get_fpga_id();
-        // std::cerr << "trying fpga " << fpga << std::endl;
-        auto num_channels = configuration::get_instance()->NUM_CHANNELS * configuration::get_instance()->NUM_ASIC;
-        for (int channel = 0; channel < num_channels; channel++) {
-            // std::cerr << "trying channel " << channel << std::endl;
+    for (auto &event : thunderdome->get_latest_event()) {
+        if (event.get_fpga_id() >= config->NUM_FPGA) {
+            continue;
+        }
+        int offset = event.get_fpga_id() * per_fpga;
+        for (int channel = 0; channel < per_fpga; channel++) {
             auto c = event.get_channel(channel);
-            if (c != nullptr) {
-                if (!c->is_complete()) {
-                    std::cerr << "Incomplete channel event" << std::endl;
-                    continue;
-                }
-                auto channel_id = lfhcal_channel_map[channel % configuration::get_instance()->NUM_CHANNELS];
-                if (channel_id < 0) {   // We record more channels than we use
-                    continue;
-                }
-                auto asic = channel >= configuration::get_instance()->NUM_CHANNELS ? 1 : 0;
-                auto x = lfhcal_get_channel_x(channel
-                );
-                auto y = lfhcal_get_channel_y(channel);
-                auto z = fpga_factors[fpga] * 16 + 8 * asic + lfhcal_get_channel_z(channel % configuration::get_instance()->NUM_CHANNELS);
-                // z = lfhcal_get_channel_z(channel % configuration::get_instance()->NUM_CHANNELS);
-
-                // std::cout << "FPGA" << fpga << "Channel" << channel << "Filling " << z << " " << x << " " << y << " " << c->get_max_sample() << std::endl;
-                event_display->Fill(z, x, y, c->get_max_sample());
-                // event_display->Fill(z, x, y, 1);
+            int bin = event_display_bins[offset + channel];
+            if (c == nullptr || bin < 0) {
+                continue;
             }
+            event_display->AddBinContent(bin, c->get_amplitude());
         }
     }
+    event_display_canvas->Modified();
+    event_display_canvas->Update();
 }
 
 void online_monitor::check_reset() {
@@ -791,7 +893,225 @@ void online_monitor::check_reset() {
                 }
             }
         }
+        pedestals->reset();
+        occupancy->reset();
+        reco->reset();
     } else if (reset == nullptr) {
         std::cerr << "Reset parameter not found" << std::endl;
     }
 }
+
+
+//********************************************************************************************
+// Draw the ring of recent raw waveforms for the channel picked with Show_Channel
+//********************************************************************************************
+void online_monitor::update_pulse_display() {
+    if (pulse_canvas == nullptr) {
+        return;
+    }
+    auto fpga = dynamic_cast<TParameter<int>*>(gROOT->FindObject("pulse_fpga"));
+    auto asic = dynamic_cast<TParameter<int>*>(gROOT->FindObject("pulse_asic"));
+    auto channel = dynamic_cast<TParameter<int>*>(gROOT->FindObject("pulse_channel"));
+    if (fpga == nullptr || asic == nullptr || channel == nullptr || fpga->GetVal() < 0) {
+        return;
+    }
+    int f = fpga->GetVal();
+    int a = asic->GetVal();
+    int c = channel->GetVal();
+    if (f >= channels.size() || a < 0 || a >= channels[f].size() || c < 0 || c >= channels[f][a].size()) {
+        std::cerr << "No channel FPGA " << f << " ASIC " << a << " channel " << c << std::endl;
+        fpga->SetVal(-1);
+        return;
+    }
+
+    auto ring = channels[f][a][c]->get_recent();
+    double ymax = 0;
+    for (int i = 0; i < ring->size(); i++) {
+        auto g = pulse_graphs[i];
+        auto samples = ring->get_samples(i);
+        g->Set(ring->get_found(i));
+        for (int j = 0; j < ring->get_found(i); j++) {
+            g->SetPoint(j, j, samples[j]);
+            ymax = std::max(ymax, (double)samples[j]);
+        }
+        g->SetTitle(Form("Timestamp %u TOT %u TOA %u", ring->get_timestamps(i)[0], ring->get_tot(i), ring->get_toa(i)));
+    }
+
+    pulse_canvas->Clear();
+    pulse_canvas->cd();
+    pulse_canvas->DrawFrame(0, 0, configuration::get_instance()->MAX_SAMPLES, 1.1 * ymax + 1,
+                            Form("FPGA %d ASIC %d Channel %d, last %d pulses (newest in red);Sample;ADC", f, a, c, ring->size()));
+    // Oldest first so the newest ends up on top
+    for (int i = ring->size() - 1; i >= 0; i--) {
+        pulse_graphs[i]->Draw("LP");
+    }
+}
+
+void online_monitor::update_zero_suppression() {
+    auto config = configuration::get_instance();
+    if (config->ZS_THRESHOLD <= 0) {
+        return;
+    }
+    for (int fpga = 0; fpga < config->NUM_FPGA; fpga++) {
+        long int kept = 0;
+        long int suppressed = 0;
+        for (auto &asic : channels[fpga]) {
+            for (auto channel : asic) {
+                kept += channel->get_events_kept();
+                suppressed += channel->get_events_suppressed();
+            }
+        }
+        zero_suppression->SetBinContent(2 * fpga + 1, kept);
+        zero_suppression->SetBinContent(2 * fpga + 2, suppressed);
+        if (debug > 0) std::cout << "FPGA " << fpga << " zero suppression kept " << kept << ", suppressed " << suppressed << " channel events" << std::endl;
+    }
+}
+
+
+//********************************************************************************************
+// Advance the rolling windows, then copy the selected one into the displayed histograms
+//********************************************************************************************
+void online_monitor::update_windows() {
+    auto config = configuration::get_instance();
+    if (config->ROLLING_WINDOWS.size() == 0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (int w = 0; w < config->ROLLING_WINDOWS.size(); w++) {
+        auto slice_length = std::chrono::seconds(60 * config->ROLLING_WINDOWS[w]) / config->ROLLING_SLICES;
+        int rotations = 0;
+        while (now - window_slice_start[w] >= slice_length) {
+            window_slice_start[w] += slice_length;
+            // After a long stall everything has expired, no point rotating further
+            if (rotations++ >= config->ROLLING_SLICES) {
+                window_slice_start[w] = now;
+                break;
+            }
+            for (auto &fpga : channels) {
+                for (auto &asic : fpga) {
+                    for (auto channel : asic) {
+                        channel->rotate_window(w);
+                    }
+                }
+            }
+        }
+    }
+
+    auto selected = dynamic_cast<TParameter<int>*>(gROOT->FindObject("rolling_window"));
+    int window = selected != nullptr ? selected->GetVal() : 0;
+    if (window < 0 || window >= config->ROLLING_WINDOWS.size()) {
+        window = 0;
+    }
+    std::string title = Form("Last %d min", config->ROLLING_WINDOWS[window]);
+    for (auto &fpga : channels) {
+        for (auto &asic : fpga) {
+            for (auto channel : asic) {
+                channel->update_window(window, title.c_str());
+            }
+        }
+    }
+}
+
+
+//********************************************************************************************
+// Checkpoints
+// Every histogram in the output file plus the file stream counters and position, so a
+// restarted monitor can pick up where the last one left off instead of rereading the run.
+// The snapshot is made in memory on the decode thread, writing it to disk happens in the background.
+//********************************************************************************************
+static const char *checkpoint_keys[] = {"NUM_FPGA", "NUM_ASIC", "MAX_SAMPLES", "PACKET_SIZE", "WAVEFORM_ADC_BINS"};
+static const int num_checkpoint_keys = 5;
+
+static int checkpoint_value(int i) {
+    auto config = configuration::get_instance();
+    int values[] = {config->NUM_FPGA, config->NUM_ASIC, config->MAX_SAMPLES, config->PACKET_SIZE, config->WAVEFORM_ADC_BINS};
+    return values[i];
+}
+
+void online_monitor::finish_checkpoint() {
+    if (checkpoint_writer.joinable()) {
+        checkpoint_writer.join();
+    }
+}
+
+void online_monitor::save_checkpoint(file_stream &fs) {
+    stage_timer timer(metrics::CHECKPOINT);
+    // Still writing the last one means the disk is slow, wait rather than pile up snapshots
+    finish_checkpoint();
+    std::string path = Form("monitoring_plots/run_%03d/run_%03d_checkpoint.root", run_number, run_number);
+    auto previous = gDirectory;
+    // Fastest compression, the snapshot holds up the decoding
+    TMemFile mem("checkpoint", "RECREATE", "", 401);
+    for (int i = 0; i < num_checkpoint_keys; i++) {
+        TParameter<int> p(checkpoint_keys[i], checkpoint_value(i));
+        mem.WriteTObject(&p);
+    }
+    for (auto obj : *output->GetList()) {
+        if (obj->InheritsFrom(TH1::Class())) {
+            mem.WriteTObject(obj);
+        }
+    }
+    fs.save_state(&mem);
+    mem.Write();
+    std::vector<char> buffer(mem.GetEND());
+    mem.CopyTo(buffer.data(), buffer.size());
+    mem.Close();
+    previous->cd();
+
+    // No ROOT from here on, the decode thread carries on with the histograms
+    checkpoint_writer = std::thread([path, buffer = std::move(buffer)]() {
+        std::string tmp = path + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(buffer.data(), buffer.size());
+        out.close();
+        if (!out) {
+            std::cerr << "Could not write " << tmp << ", skipping checkpoint" << std::endl;
+            return;
+        }
+        // Only replace the old checkpoint once the new one is complete
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            perror("Saving checkpoint");
+        }
+    });
+}
+
+bool online_monitor::restore_checkpoint(file_stream &fs) {
+    std::string path = Form("monitoring_plots/run_%03d/run_%03d_checkpoint.root", run_number, run_number);
+    finish_checkpoint();
+    if (gSystem->AccessPathName(path.c_str())) {
+        return false;
+    }
+    auto previous = gDirectory;
+    TFile f(path.c_str(), "READ");
+    bool good = !f.IsZombie();
+    for (int i = 0; good && i < num_checkpoint_keys; i++) {
+        TParameter<int> *p = nullptr;
+        f.GetObject(checkpoint_keys[i], p);
+        if (p == nullptr || p->GetVal() != checkpoint_value(i)) {
+            std::cerr << "Checkpoint " << path << " was made with a different " << checkpoint_keys[i] << ", ignoring it" << std::endl;
+            good = false;
+        }
+        delete p;
+    }
+    if (good) {
+        good = fs.restore_state(&f);
+    }
+    if (good) {
+        std::cout << "Restoring histograms from " << path << std::endl;
+        for (auto obj : *output->GetList()) {
+            if (!obj->InheritsFrom(TH1::Class())) {
+                continue;
+            }
+            TH1 *saved = nullptr;
+            f.GetObject(obj->GetName(), saved);
+            if (saved != nullptr) {
+                auto hist = (TH1*)obj;
+                hist->Reset("ICESM");
+                hist->Add(saved);
+            }
+        }
+    }
+    f.Close();
+    previous->cd();
+    return good;
+}
@@ -2,16 +2,25 @@
 
 #include "canvas_manager.h"
 #include "line_stream.h"
+#include "file_stream.h"
+#include "pulse_features.h"
+#include "shower_reco.h"
 
 #include <TROOT.h>
 #include <TFile.h>
 #include <TH2.h>
 #include <TH3.h>
+#include <TGraph.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
 
 class online_monitor {
 private:
     int run_number;
     int timestamp; 
+    int debug;
     TFile *output;
     canvas_manager canvases;
 
@@ -19,11 +28,31 @@ private:
     std::vector<TH2*> tot_per_channel;
     std::vector<TH2*> toa_per_channel;
 
-    uint32_t event_drawn;
-    TH3 *event_display;
+    uint64_t event_drawn;       // Built events when the display was last drawn
+    TH1 *event_display;
+    TCanvas *event_display_canvas;
+    std::vector<int> event_display_bins;    // [global channel], bin in event_display or -1
 
     event_builder **builders;
+    // Workers only see their own FPGAs, so events would never align there
+    bool building_events;
     event_thunderdome *thunderdome;
+    shower_reco *reco;
+    pedestal_tracker *pedestals;
+    occupancy_tracker *occupancy;
+    TH1 *zero_suppression;
+    pulse_features *features;
+    std::vector<channel_stream*> feature_channels;
+    TCanvas *pulse_canvas;
+    std::vector<TGraph*> pulse_graphs;
+
+    void process_features();
+    void hand_to_builder(single_channel_event *event);
+
+    std::vector<std::chrono::steady_clock::time_point> window_slice_start;
+
+    std::thread checkpoint_writer;      // Writes the last checkpoint to disk
+    void finish_checkpoint();
 
 public:
     channel_stream_vector channels;
@@ -41,4 +70,15 @@ public:
     void build_events();
     void make_event_display();
     void check_reset();
+    void update_windows();
+    void update_pedestals() {pedestals->update_maps();}
+    void update_occupancy() {occupancy->update();}
+    void update_pulse_template() {features->update_template();}
+    void update_pulse_display();
+    void update_zero_suppression();
+    // Write out the current run and carry on with the next one in the same histograms
+    void start_run(int run_number);
+    int get_run_number() {return run_number;}
+    void save_checkpoint(file_stream &fs);
+    bool restore_checkpoint(file_stream &fs);
 };
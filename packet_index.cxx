@@ -0,0 +1,185 @@
+#include "packet_index.h"
+
+#include "decoders.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+// "H2GIDX" + format version
+static const char index_magic[8] = {'H', '2', 'G', 'I', 'D', 'X', 0, 1};
+
+struct index_header {
+    char magic[8];
+    uint64_t data_start;
+    uint32_t packet_size;
+    uint32_t spare;
+};
+
+packet_index::packet_index(const char *run_file, uint64_t data_start, uint32_t packet_size, int num_fpga) {
+    run_name = run_file;
+    index_name = run_name + ".idx";
+    this->data_start = data_start;
+    this->packet_size = packet_size;
+    indexed_until = data_start;
+    saved_until = data_start;
+    saved_records = 0;
+    writable = true;
+    packets.resize(num_fpga);
+    packets_since_entry.resize(num_fpga, INDEX_STRIDE);
+    load();
+}
+
+//********************************************************************************************
+// Read an existing index, as long as it was made with the same header and packet size and
+// doesn't reach past the end of the run file, which may have been truncated or rewritten
+//********************************************************************************************
+void packet_index::load() {
+    std::ifstream in(index_name, std::ios::in | std::ios::binary);
+    if (!in.good()) {
+        return;
+    }
+    index_header header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in.good() || memcmp(header.magic, index_magic, sizeof(index_magic)) != 0 || header.data_start != data_start || header.packet_size != packet_size) {
+        std::cout << "Ignoring stale packet index " << index_name << std::endl;
+        in.close();
+        // Start over with a fresh file
+        std::remove(index_name.c_str());
+        return;
+    }
+
+    std::vector<index_record> records;
+    index_record r;
+    while (in.read(reinterpret_cast<char*>(&r), sizeof(r))) {
+        records.push_back(r);
+    }
+    // Only trust what was covered by the last progress marker, anything after it may be half written
+    size_t valid = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (records[i].type == INDEX_PROGRESS) {
+            valid = i + 1;
+        }
+    }
+    std::ifstream data(run_name, std::ios::in | std::ios::binary | std::ios::ate);
+    uint64_t data_size = data.good() ? (uint64_t)data.tellg() : 0;
+    if (valid > 0 && records[valid - 1].offset > data_size) {
+        std::cout << "Ignoring packet index " << index_name << ", it goes past the end of the run file" << std::endl;
+        in.close();
+        std::remove(index_name.c_str());
+        return;
+    }
+    for (size_t i = 0; i < valid; i++) {
+        auto &rec = records[i];
+        if (rec.type == INDEX_HEARTBEAT) {
+            heartbeats.push_back(rec);
+        } else if (rec.type == INDEX_PACKET && rec.a < packets.size()) {
+            packets[rec.a].push_back(rec);
+            packets_since_entry[rec.a] = 0;
+        } else if (rec.type == INDEX_PROGRESS) {
+            indexed_until = rec.offset;
+        }
+    }
+    saved_until = indexed_until;
+    saved_records = valid;
+    if (valid != records.size()) {
+        // Drop the torn tail so appends line up again
+        std::vector<index_record> keep(records.begin(), records.begin() + valid);
+        std::ofstream out(index_name, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(keep.data()), keep.size() * sizeof(index_record));
+    }
+    std::cout << "Loaded packet index " << index_name << ": " << heartbeats.size() << " heartbeats, indexed up to byte " << indexed_until << std::endl;
+}
+
+//********************************************************************************************
+// Called for every packet read, packets behind what we've already indexed are ignored
+//********************************************************************************************
+void packet_index::add(uint64_t offset, uint8_t *buffer) {
+    if (offset < indexed_until) {
+        return;
+    }
+    indexed_until = offset + packet_size;
+
+    uint32_t packet_number, fpga_id;
+    int type = classify_packet(buffer, packet_number, fpga_id);
+    if (type == 2) {
+        index_record r = {offset, INDEX_HEARTBEAT, bit_converter(buffer, 12, false), bit_converter(buffer, 16, false), 0};
+        heartbeats.push_back(r);
+        unsaved.push_back(r);
+        return;
+    }
+    if (fpga_id >= packets.size()) {
+        return;
+    }
+    if (packets_since_entry[fpga_id] >= INDEX_STRIDE) {
+        index_record r = {offset, INDEX_PACKET, fpga_id, packet_number, 0};
+        packets[fpga_id].push_back(r);
+        unsaved.push_back(r);
+        packets_since_entry[fpga_id] = 0;
+    }
+    packets_since_entry[fpga_id]++;
+}
+
+//********************************************************************************************
+// Append whatever is new to the index file, nothing if the file hasn't grown since the last save
+//********************************************************************************************
+void packet_index::save() {
+    if (!writable || (unsaved.empty() && indexed_until == saved_until)) {
+        return;
+    }
+    std::ofstream out;
+    if (saved_records == 0) {
+        out.open(index_name, std::ios::out | std::ios::binary | std::ios::trunc);
+        index_header header;
+        memcpy(header.magic, index_magic, sizeof(index_magic));
+        header.data_start = data_start;
+        header.packet_size = packet_size;
+        header.spare = 0;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    } else {
+        out.open(index_name, std::ios::out | std::ios::binary | std::ios::app);
+    }
+    if (!out.good()) {
+        std::cerr << "Can't write packet index " << index_name << ", not caching it" << std::endl;
+        writable = false;
+        return;
+    }
+    unsaved.push_back({indexed_until, INDEX_PROGRESS, 0, 0, 0});
+    out.write(reinterpret_cast<const char*>(unsaved.data()), unsaved.size() * sizeof(index_record));
+    saved_records += unsaved.size();
+    saved_until = indexed_until;
+    unsaved.clear();
+}
+
+int64_t packet_index::find_time(uint32_t seconds) {
+    // Heartbeats are written in order, so binary search on the time
+    size_t lo = 0, hi = heartbeats.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (heartbeats[mid].a < seconds) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == heartbeats.size()) {
+        return -1;
+    }
+    return heartbeats[lo].offset;
+}
+
+int64_t packet_index::find_packet(uint32_t fpga_id, uint32_t packet_number) {
+    if (fpga_id >= packets.size()) {
+        return -1;
+    }
+    // Packet numbers only go up within a run, so find the last entry <= packet_number
+    auto &entries = packets[fpga_id];
+    auto it = std::upper_bound(entries.begin(), entries.end(), packet_number, [](uint32_t n, const index_record &r) {return n < r.b;});
+    if (it == entries.begin()) {
+        return -1;
+    }
+    return std::prev(it)->offset;
+}
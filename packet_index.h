@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// On-disk record, the index file is just a header followed by these
+struct index_record {
+    uint64_t offset;        // byte offset of the packet in the run file
+    uint32_t type;          // see index_record_type
+    uint32_t a;             // heartbeat: seconds,      packet: fpga id
+    uint32_t b;             // heartbeat: milliseconds, packet: packet number
+    uint32_t spare;
+};
+
+enum index_record_type {
+    INDEX_HEARTBEAT = 0,
+    INDEX_PACKET = 1,
+    INDEX_PROGRESS = 2,     // everything before offset has been indexed
+};
+
+// Sparse index of a run file: every heartbeat, plus every INDEX_STRIDE-th packet of each FPGA.
+// It is built as the file is read and cached next to the run as RunXXX.h2g.idx, so a
+// later process can jump straight to a time or packet number.
+class packet_index {
+private:
+    std::string run_name;
+    std::string index_name;
+    uint64_t data_start;
+    uint32_t packet_size;
+    uint64_t indexed_until;
+    uint64_t saved_until;       // indexed_until of the last progress record in the file
+    size_t saved_records;
+    bool writable;
+
+    std::vector<index_record> heartbeats;
+    std::vector<std::vector<index_record>> packets;     // [fpga]
+    std::vector<uint32_t> packets_since_entry;          // [fpga]
+    std::vector<index_record> unsaved;
+
+    void load();
+
+public:
+    static const uint32_t INDEX_STRIDE = 256;
+
+    packet_index(const char *run_file, uint64_t data_start, uint32_t packet_size, int num_fpga);
+
+    void add(uint64_t offset, uint8_t *buffer);
+    void save();
+
+    uint64_t get_indexed_until() {return indexed_until;}
+    // True once we've indexed past packet_number for this FPGA
+    bool covers_packet(uint32_t fpga_id, uint32_t packet_number) {return fpga_id < packets.size() && !packets[fpga_id].empty() && packets[fpga_id].back().b > packet_number;}
+    size_t get_num_heartbeats() {return heartbeats.size();}
+
+    // Offset of the first heartbeat at or after the given time, or -1 if not indexed yet
+    int64_t find_time(uint32_t seconds);
+    // Offset of the last indexed packet at or before packet_number, or -1
+    int64_t find_packet(uint32_t fpga_id, uint32_t packet_number);
+};
@@ -0,0 +1,258 @@
+#include "packet_stream.h"
+
+#include "configuration.h"
+#include "canvas_manager.h"
+#include "server.h"
+#include "decoders.h"
+#include "metrics.h"
+
+#include <TGraph.h>
+#include <TMultiGraph.h>
+#include <TCanvas.h>
+#include <TAxis.h>
+#include <TROOT.h>
+#include <TDatime.h>
+#include <TLegend.h>
+
+#include <chrono>
+#include <iostream>
+
+// Packet numbers are 16 bits before v0.13 and 32 bits after
+static int packet_number_bits() {
+    return configuration::get_instance()->FILE_VERSION_MINOR > 12 ? 32 : 16;
+}
+
+static TGraph *rate_graph(const char *name, const char *title, const char *y_title, int color) {
+    auto graph = new TGraph();
+    graph->SetName(name);
+    gROOT->Add(graph);
+    graph->SetTitle(title);
+    graph->GetXaxis()->SetTitle("Time");
+    graph->GetXaxis()->SetTimeDisplay(1);
+    graph->GetXaxis()->SetTimeFormat("%H:%M:%S");
+    graph->GetYaxis()->SetTitle(y_title);
+    graph->SetLineColor(color);
+    graph->SetLineWidth(2);
+    return graph;
+}
+
+//********************************************************************************************
+// Packet loss graphs, shared by every input
+//********************************************************************************************
+packet_stream::packet_stream() {
+    auto config     = configuration::get_instance();    
+    trackers        = new sequence_tracker[config->NUM_FPGA];
+    canvas_id       = new int[config->NUM_FPGA];
+    received_packet_graphs        = new TGraph*[config->NUM_FPGA];
+    missed_packet_graphs          = new TGraph*[config->NUM_FPGA];
+    missed_packet_graphs_percent  = new TGraph*[config->NUM_FPGA];
+    mg              = new TMultiGraph*[config->NUM_FPGA];
+    received_series       = new timeseries*[config->NUM_FPGA];
+    missed_series         = new timeseries*[config->NUM_FPGA];
+    missed_percent_series = new timeseries*[config->NUM_FPGA];
+    lost_rate_graphs      = new TGraph*[config->NUM_FPGA];
+    late_rate_graphs      = new TGraph*[config->NUM_FPGA];
+    duplicate_rate_graphs = new TGraph*[config->NUM_FPGA];
+    lost_rate_series      = new timeseries*[config->NUM_FPGA];
+    late_rate_series      = new timeseries*[config->NUM_FPGA];
+    duplicate_rate_series = new timeseries*[config->NUM_FPGA];
+    last_counts           = new sequence_counts[config->NUM_FPGA];
+    reset_counters();
+
+    auto canvases = canvas_manager::get_instance();
+    auto s = server::get_instance();
+    for (int i = 0; i < config->NUM_FPGA; i++) {
+        mg[i] = nullptr;
+        
+        canvas_id[i] = canvases.new_canvas(Form("FPGA_Events_%i_Packets", i), Form("FPGA %i Packets", i), 1200, 800);
+        s->register_object("/QA Plots/DAQ Performance", canvases.get_canvas(canvas_id[i]));
+        TLegend *legend = new TLegend(0.15, 0.75, 0.48, 0.9);
+        legend->SetBorderSize(0);
+        
+        received_packet_graphs[i] = new TGraph();
+        received_packet_graphs[i]->SetName(Form("fpga_%i_packets", i));
+        gROOT->Add(received_packet_graphs[i]);
+        received_series[i] = new timeseries(received_packet_graphs[i], timeseries::MAX);
+        received_packet_graphs[i]->SetTitle(Form("FPGA %i Packets", i));
+        received_packet_graphs[i]->GetXaxis()->SetTitle("Time");
+        received_packet_graphs[i]->GetXaxis()->SetTimeDisplay(1);
+        received_packet_graphs[i]->GetXaxis()->SetTimeFormat("%H:%M:%S");
+        received_packet_graphs[i]->GetYaxis()->SetTitle("Packets");
+        received_packet_graphs[i]->SetLineColor(kBlue);
+        received_packet_graphs[i]->SetLineWidth(2);
+        received_packet_graphs[i]->Draw("AL");
+        legend->AddEntry(received_packet_graphs[i], "Received Packets", "l");
+
+        missed_packet_graphs[i] = new TGraph();
+        missed_packet_graphs[i]->SetName(Form("fpga_%i_missed_packets", i));
+        gROOT->Add(missed_packet_graphs[i]);
+        missed_series[i] = new timeseries(missed_packet_graphs[i], timeseries::MAX);
+        missed_packet_graphs[i]->SetTitle(Form("FPGA %i Missed Packets", i));
+        missed_packet_graphs[i]->GetXaxis()->SetTitle("Time");
+        missed_packet_graphs[i]->GetXaxis()->SetTimeDisplay(1);
+        missed_packet_graphs[i]->GetXaxis()->SetTimeFormat("%H:%M:%S");
+        missed_packet_graphs[i]->GetYaxis()->SetTitle("Missed Packets");
+        missed_packet_graphs[i]->SetLineColor(kRed);
+        missed_packet_graphs[i]->SetLineWidth(2);
+        legend->AddEntry(missed_packet_graphs[i], "Missed Packets", "l");
+        missed_packet_graphs[i]->Draw("L");
+
+        legend->Draw();
+
+        missed_packet_graphs_percent[i] = new TGraph();
+        missed_packet_graphs_percent[i]->SetName(Form("fpga_%i_missed_packets_percent", i));
+        gROOT->Add(missed_packet_graphs_percent[i]);
+        missed_percent_series[i] = new timeseries(missed_packet_graphs_percent[i], timeseries::MAX);
+        missed_packet_graphs_percent[i]->SetTitle(Form("FPGA %i Missed Packets Percent", i));
+        missed_packet_graphs_percent[i]->GetXaxis()->SetTitle("Time");
+        missed_packet_graphs_percent[i]->GetXaxis()->SetTimeDisplay(1);
+        missed_packet_graphs_percent[i]->GetXaxis()->SetTimeFormat("%H:%M:%S");
+        missed_packet_graphs_percent[i]->GetYaxis()->SetTitle("Missed Packets Percent");
+        missed_packet_graphs_percent[i]->SetLineColor(kGreen+2);
+        missed_packet_graphs_percent[i]->SetLineWidth(2);
+        legend->AddEntry(missed_packet_graphs_percent[i], "Missed Packets Percent", "l");
+        missed_packet_graphs_percent[i]->Draw("LY+");
+    }
+
+    sequence_canvas_id = canvases.new_canvas("Packet_Sequence", "Packet Sequence", 1200, 800);
+    auto c = canvases.get_canvas(sequence_canvas_id);
+    s->register_object("/QA Plots/DAQ Performance", c);
+    c->Divide(1, 3);
+    int colors[4] = {kBlue, kRed, kGreen + 2, kOrange};
+    for (int i = 0; i < config->NUM_FPGA; i++) {
+        // Bursts matter more than the average when tuning buffers, so show the worst of each bucket
+        lost_rate_graphs[i] = rate_graph(Form("fpga_%i_lost_packet_rate", i), "Lost Packets", "Lost Packets / s", colors[i % 4]);
+        lost_rate_series[i] = new timeseries(lost_rate_graphs[i], timeseries::MAX);
+        c->cd(1);
+        lost_rate_graphs[i]->Draw(i == 0 ? "AL" : "L");
+        late_rate_graphs[i] = rate_graph(Form("fpga_%i_late_packet_rate", i), "Late (Reordered) Packets", "Late Packets / s", colors[i % 4]);
+        late_rate_series[i] = new timeseries(late_rate_graphs[i], timeseries::MAX);
+        c->cd(2);
+        late_rate_graphs[i]->Draw(i == 0 ? "AL" : "L");
+        duplicate_rate_graphs[i] = rate_graph(Form("fpga_%i_duplicate_packet_rate", i), "Duplicate Packets", "Duplicate Packets / s", colors[i % 4]);
+        duplicate_rate_series[i] = new timeseries(duplicate_rate_graphs[i], timeseries::MAX);
+        c->cd(3);
+        duplicate_rate_graphs[i]->Draw(i == 0 ? "AL" : "L");
+    }
+}
+
+packet_stream::~packet_stream() {
+    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
+        delete received_packet_graphs[i];
+        delete missed_packet_graphs[i];
+        delete missed_packet_graphs_percent[i];
+        delete mg[i];
+        delete received_series[i];
+        delete missed_series[i];
+        delete missed_percent_series[i];
+        delete lost_rate_graphs[i];
+        delete late_rate_graphs[i];
+        delete duplicate_rate_graphs[i];
+        delete lost_rate_series[i];
+        delete late_rate_series[i];
+        delete duplicate_rate_series[i];
+    }
+    delete[] trackers;
+    delete[] canvas_id;
+    delete[] received_packet_graphs;
+    delete[] missed_packet_graphs;
+    delete[] missed_packet_graphs_percent;
+    delete[] mg;
+    delete[] received_series;
+    delete[] missed_series;
+    delete[] missed_percent_series;
+    delete[] lost_rate_graphs;
+    delete[] late_rate_graphs;
+    delete[] duplicate_rate_graphs;
+    delete[] lost_rate_series;
+    delete[] late_rate_series;
+    delete[] duplicate_rate_series;
+    delete[] last_counts;
+}
+
+void packet_stream::reset_counters() {
+    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
+        trackers[i].reset();
+        trackers[i].set_bits(packet_number_bits());
+        last_counts[i] = trackers[i].get_counts();
+    }
+    last_rate_time = -1;
+}
+
+//********************************************************************************************
+// Packet counters, printed and added to the graphs every refresh
+//********************************************************************************************
+void packet_stream::print_packet_numbers() {
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    double elapsed = now - last_rate_time;
+    for (int i = 0; i < configuration::get_instance()->NUM_FPGA; i++) {
+        auto time = TDatime();
+        auto counts = trackers[i].get_counts();
+        auto lost = counts.missing + counts.outstanding;
+        std::cout << "\n===========================================" << std::endl;
+        std::cout << "FPGA " << i << " statistics" << std::endl;
+        std::cout << "Received total: "<< "\t"<< counts.received << "\t missed total:\t" << lost << std::endl;
+        std::cout << "Late: " << "\t" << counts.late << "\t duplicate:\t" << counts.duplicate << "\t too late to place:\t" << counts.stale << std::endl;
+        std::cout << "===========================================" << std::endl;
+        received_series[i]->add(time.Convert(), counts.received);
+        received_packet_graphs[i]->GetYaxis()->SetRangeUser(0, 1.2 * (float)counts.received);
+        missed_series[i]->add(time.Convert(), lost);
+        missed_percent_series[i]->add(time.Convert(), (double)lost / counts.expected);
+        missed_packet_graphs_percent[i]->GetYaxis()->SetRangeUser(0, 1);
+
+        // Rates from confirmed losses only, the outstanding ones may still turn up late
+        if (last_rate_time >= 0 && elapsed > 0) {
+            lost_rate_series[i]->add(time.Convert(), (counts.missing - last_counts[i].missing) / elapsed);
+            late_rate_series[i]->add(time.Convert(), (counts.late - last_counts[i].late) / elapsed);
+            duplicate_rate_series[i]->add(time.Convert(), (counts.duplicate - last_counts[i].duplicate) / elapsed);
+        }
+        last_counts[i] = counts;
+    }
+    last_rate_time = now;
+}
+
+
+
+//********************************************************************************************
+// Packet loss accounting, returns 2 for heartbeats and 1 for data packets
+// Each FPGA's tracker sorts the packet into in order, late, duplicate or after a gap
+//********************************************************************************************
+int packet_stream::count_packet(uint8_t *buffer) {
+    // Check if this is a heartbeat packet, otherwise determine to which fpga this packet belongs
+    uint32_t packet_number, fpga_id;
+    auto counters = metrics::get_instance();
+    if (classify_packet(buffer, packet_number, fpga_id) == 2) {
+        counters->heartbeats.fetch_add(1, std::memory_order_relaxed);
+        return 2;
+    }
+    metrics::add(counters->packets_read, fpga_id);
+    if (fpga_id >= (uint32_t)configuration::get_instance()->NUM_FPGA) {
+        return 1;
+    }
+  
+// Decompose beginning of each packet    
+//     for (int i = 0; i < 192/8; i++){
+//       for (int j = 0; j < 8; j++){
+//         std::cout << std::hex <<int(buffer[i*8+j]) << "\t" ;
+//       }
+//       std::cout << std::endl;  
+//     }
+//     std::cout << std::dec << std::endl;  
+//     
+    auto &tracker = trackers[fpga_id];
+    auto missing_before = tracker.get_missing();
+    switch (tracker.add(packet_number)) {
+        case sequence_tracker::LATE:
+            metrics::add(counters->packets_late, fpga_id);
+            break;
+        case sequence_tracker::DUPLICATE:
+            metrics::add(counters->packets_duplicate, fpga_id);
+            break;
+        default:
+            break;
+    }
+    if (tracker.get_missing() != missing_before) {
+        metrics::add(counters->packets_missing, fpga_id, tracker.get_missing() - missing_before);
+    }
+    return 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "timeseries.h"
+#include "sequence_tracker.h"
+
+#include <TGraph.h>
+#include <TMultiGraph.h>
+
+#include <cstdint>
+
+// Somewhere packets come from, the run file or the network.  Keeps the per FPGA packet
+// counters and their graphs, so every input does the same packet loss accounting.
+class packet_stream {
+protected:
+    sequence_tracker *trackers;
+    int *canvas_id;
+    TGraph **received_packet_graphs;
+    TGraph **missed_packet_graphs;
+    TGraph **missed_packet_graphs_percent;
+    TMultiGraph **mg;
+    // Bounded histories behind the graphs.  The counters only go up within a run, so the
+    // graphs show the largest value of each bucket.
+    timeseries **received_series;
+    timeseries **missed_series;
+    timeseries **missed_percent_series;
+    // Per second rates of lost, late and duplicate packets, one graph per FPGA on each pad
+    int sequence_canvas_id;
+    TGraph **lost_rate_graphs;
+    TGraph **late_rate_graphs;
+    TGraph **duplicate_rate_graphs;
+    timeseries **lost_rate_series;
+    timeseries **late_rate_series;
+    timeseries **duplicate_rate_series;
+    sequence_counts *last_counts;
+    double last_rate_time;
+
+    // Call on every packet read, returns 2 for heartbeats and 1 for data
+    int count_packet(uint8_t *buffer);
+    void reset_counters();
+
+public:
+    packet_stream();
+    virtual ~packet_stream();
+    // Fill buffer with the next PACKET_SIZE bytes, returns 0 if there's nothing yet, 1 for data and 2 for heartbeats
+    virtual int read_packet(uint8_t *buffer) = 0;
+    virtual void wait_for_data(int timeout_ms) = 0;
+    // Bytes waiting to be read
+    virtual uint64_t get_backlog() = 0;
+    // Whether an empty read means the input has ended, rather than that it's waiting for more
+    virtual bool finished() = 0;
+    virtual void print_packet_numbers();
+    sequence_counts get_sequence_counts(int fpga) {return trackers[fpga].get_counts();}
+};
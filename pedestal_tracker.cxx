@@ -0,0 +1,120 @@
+#include "pedestal_tracker.h"
+
+#include "configuration.h"
+#include "canvas_manager.h"
+#include "server.h"
+#include "mapping.h"
+
+#include <TH2.h>
+#include <TCanvas.h>
+
+#include <algorithm>
+#include <cmath>
+
+pedestal_tracker::pedestal_tracker() {
+    auto config = configuration::get_instance();
+    num_channels = config->NUM_FPGA * config->NUM_ASIC * config->NUM_CHANNELS;
+    num_samples = config->MAX_SAMPLES;
+    count = std::vector<uint64_t>(num_channels, 0);
+    pedestal_mean = std::vector<double>(num_channels, 0);
+    pedestal_m2 = std::vector<double>(num_channels, 0);
+    sample_mean = std::vector<double>((size_t)num_channels * num_samples, 0);
+    sample_m2 = std::vector<double>((size_t)num_channels * num_samples, 0);
+
+    auto canvases = canvas_manager::get_instance();
+    auto s = server::get_instance();
+    for (int i = 0; i < config->NUM_FPGA; i++) {
+        pedestal_map.push_back(new TH2D(Form("pedestal_map_%d", i), Form("Pedestal FPGA %d;Channel;ASIC", i), config->NUM_CHANNELS, 0, config->NUM_CHANNELS, config->NUM_ASIC, 0, config->NUM_ASIC));
+        noise_map.push_back(new TH2D(Form("noise_map_%d", i), Form("Noise (RMS of first sample) FPGA %d;Channel;ASIC", i), config->NUM_CHANNELS, 0, config->NUM_CHANNELS, config->NUM_ASIC, 0, config->NUM_ASIC));
+        sample_map.push_back(new TH2D(Form("sample_mean_map_%d", i), Form("Mean ADC per Sample FPGA %d;Channel + 72 * ASIC;Sample", i), config->NUM_CHANNELS * config->NUM_ASIC, 0, config->NUM_CHANNELS * config->NUM_ASIC, num_samples, 0, num_samples));
+        sample_noise_map.push_back(new TH2D(Form("sample_noise_map_%d", i), Form("ADC RMS per Sample FPGA %d;Channel + 72 * ASIC;Sample", i), config->NUM_CHANNELS * config->NUM_ASIC, 0, config->NUM_CHANNELS * config->NUM_ASIC, num_samples, 0, num_samples));
+        s->register_object("/QA Plots/Pedestals", pedestal_map.back());
+        s->register_object("/QA Plots/Pedestals", noise_map.back());
+        s->register_object("/QA Plots/Pedestals", sample_map.back());
+        s->register_object("/QA Plots/Pedestals", sample_noise_map.back());
+
+        int c = canvases.new_canvas(Form("Pedestals_FPGA_%d", i), Form("Pedestals FPGA %d", i), 1200, 800);
+        auto canvas = canvases.get_canvas(c);
+        s->register_object("/QA Plots/Pedestals", canvas);
+        canvas->Divide(2, 2);
+        canvas->cd(1);
+        pedestal_map[i]->Draw("colz");
+        canvas->cd(2);
+        noise_map[i]->Draw("colz");
+        canvas->cd(3);
+        sample_map[i]->Draw("colz");
+        canvas->cd(4);
+        sample_noise_map[i]->Draw("colz");
+    }
+}
+
+pedestal_tracker::~pedestal_tracker() {
+    for (size_t i = 0; i < pedestal_map.size(); i++) {
+        delete pedestal_map[i];
+        delete noise_map[i];
+        delete sample_map[i];
+        delete sample_noise_map[i];
+    }
+}
+
+void pedestal_tracker::update(int ch, const uint32_t *samples, int n) {
+    n = std::min(n, num_samples);
+    if (n <= 0) {
+        return;
+    }
+    double inverse = 1.0 / ++count[ch];
+
+    double delta = samples[0] - pedestal_mean[ch];
+    pedestal_mean[ch] += delta * inverse;
+    pedestal_m2[ch] += delta * (samples[0] - pedestal_mean[ch]);
+
+    double *mean = sample_mean.data() + (size_t)ch * num_samples;
+    double *m2 = sample_m2.data() + (size_t)ch * num_samples;
+    for (int i = 0; i < n; i++) {
+        double d = samples[i] - mean[i];
+        mean[i] += d * inverse;
+        m2[i] += d * (samples[i] - mean[i]);
+    }
+}
+
+double pedestal_tracker::get_noise(int ch) {
+    if (count[ch] < 2) {
+        return 0;
+    }
+    return std::sqrt(pedestal_m2[ch] / (count[ch] - 1));
+}
+
+double pedestal_tracker::get_sample_noise(int ch, int sample) {
+    if (count[ch] < 2) {
+        return 0;
+    }
+    return std::sqrt(sample_m2[(size_t)ch * num_samples + sample] / (count[ch] - 1));
+}
+
+//********************************************************************************************
+// Copy the running values into the published maps, once per refresh
+//********************************************************************************************
+void pedestal_tracker::update_maps() {
+    auto config = configuration::get_instance();
+    for (int fpga = 0; fpga < config->NUM_FPGA; fpga++) {
+        for (int asic = 0; asic < config->NUM_ASIC; asic++) {
+            for (int channel = 0; channel < config->NUM_CHANNELS; channel++) {
+                int ch = geometry::global_channel(fpga, asic, channel);
+                pedestal_map[fpga]->SetBinContent(channel + 1, asic + 1, pedestal_mean[ch]);
+                noise_map[fpga]->SetBinContent(channel + 1, asic + 1, get_noise(ch));
+                for (int sample = 0; sample < num_samples; sample++) {
+                    sample_map[fpga]->SetBinContent(asic * config->NUM_CHANNELS + channel + 1, sample + 1, sample_mean[(size_t)ch * num_samples + sample]);
+                    sample_noise_map[fpga]->SetBinContent(asic * config->NUM_CHANNELS + channel + 1, sample + 1, get_sample_noise(ch, sample));
+                }
+            }
+        }
+    }
+}
+
+void pedestal_tracker::reset() {
+    std::fill(count.begin(), count.end(), 0);
+    std::fill(pedestal_mean.begin(), pedestal_mean.end(), 0);
+    std::fill(pedestal_m2.begin(), pedestal_m2.end(), 0);
+    std::fill(sample_mean.begin(), sample_mean.end(), 0);
+    std::fill(sample_m2.begin(), sample_m2.end(), 0);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <TH2.h>
+
+#include <cstdint>
+#include <vector>
+
+// Running pedestal and noise for every channel of every FPGA and ASIC (by geometry::global_channel), using Welford's
+// algorithm so it's one update per event and never needs a second pass over the data.
+// The pedestal is the first sample of each event, the per sample means give the average
+// waveform.  Stored as flat arrays indexed by global channel, [channel * MAX_SAMPLES + sample]
+// for the per sample ones, so one event touches one contiguous stretch.
+class pedestal_tracker {
+private:
+    int num_channels;
+    int num_samples;
+
+    std::vector<uint64_t> count;
+    std::vector<double> pedestal_mean;
+    std::vector<double> pedestal_m2;
+    std::vector<double> sample_mean;
+    std::vector<double> sample_m2;
+
+    std::vector<TH2*> pedestal_map;     // [fpga], channel vs asic
+    std::vector<TH2*> noise_map;
+    std::vector<TH2*> sample_map;       // [fpga], channel vs sample index
+    std::vector<TH2*> sample_noise_map;
+
+public:
+    pedestal_tracker();
+    ~pedestal_tracker();
+
+    void update(int global_channel, const uint32_t *samples, int n);
+    double get_pedestal(int global_channel) {return pedestal_mean[global_channel];}
+    double get_noise(int global_channel);
+    double get_sample_noise(int global_channel, int sample);
+    uint64_t get_count(int global_channel) {return count[global_channel];}
+
+    void update_maps();
+    void reset();
+};
@@ -0,0 +1,160 @@
+#include "pulse_features.h"
+
+#include "configuration.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Only pulses this far above pedestal go into the template
+static const float template_min_amplitude = 50;
+static const uint64_t template_min_events = 1000;
+
+pulse_features::pulse_features(int capacity) {
+    this->capacity = capacity;
+    num_samples = configuration::get_instance()->MAX_SAMPLES;
+    size = 0;
+    samples = std::vector<float>((size_t)num_samples * capacity, 0);
+    pedestal = std::vector<float>(capacity, 0);
+    max_value = std::vector<float>(capacity, 0);
+    peak_index = std::vector<int>(capacity, 0);
+    fit_a = std::vector<float>(capacity, 0);
+    fit_b = std::vector<float>(capacity, 0);
+    amplitude = std::vector<float>(capacity, 0);
+    integral = std::vector<float>(capacity, 0);
+    peak_time = std::vector<float>(capacity, 0);
+    events.reserve(capacity);
+
+    template_sum = std::vector<double>(2 * TEMPLATE_HALF + 1, 0);
+    template_events = 0;
+    // Start with a gaussian, sigma of 1.5 samples
+    double shape[2 * TEMPLATE_HALF + 1];
+    for (int k = -TEMPLATE_HALF; k <= TEMPLATE_HALF; k++) {
+        shape[k + TEMPLATE_HALF] = std::exp(-0.5 * k * k / (1.5 * 1.5));
+    }
+    set_weights(shape);
+}
+
+void pulse_features::add(single_channel_event *e, float event_pedestal) {
+    int n = std::min((int)e->found_samples, num_samples);
+    for (int s = 0; s < n; s++) {
+        samples[(size_t)s * capacity + size] = e->samples[s];
+    }
+    // Short events are padded with the pedestal so they don't add to the integral
+    for (int s = n; s < num_samples; s++) {
+        samples[(size_t)s * capacity + size] = event_pedestal;
+    }
+    pedestal[size] = event_pedestal;
+    events.push_back(e);
+    size++;
+}
+
+//********************************************************************************************
+// Weights of the linearized template fit, from the template sampled at k = -TEMPLATE_HALF..TEMPLATE_HALF
+//********************************************************************************************
+void pulse_features::set_weights(const double *shape) {
+    double t[2 * WINDOW + 1], d[2 * WINDOW + 1];
+    for (int k = -WINDOW; k <= WINDOW; k++) {
+        t[k + WINDOW] = shape[k + TEMPLATE_HALF];
+        d[k + WINDOW] = 0.5 * (shape[k + TEMPLATE_HALF + 1] - shape[k + TEMPLATE_HALF - 1]);
+    }
+    double tt = 0, td = 0, dd = 0;
+    for (int k = 0; k < 2 * WINDOW + 1; k++) {
+        tt += t[k] * t[k];
+        td += t[k] * d[k];
+        dd += d[k] * d[k];
+    }
+    double det = tt * dd - td * td;
+    if (std::fabs(det) < 1e-12) {
+        return;
+    }
+    for (int k = 0; k < 2 * WINDOW + 1; k++) {
+        weight_a[k] = (dd * t[k] - td * d[k]) / det;
+        weight_b[k] = (tt * d[k] - td * t[k]) / det;
+    }
+}
+
+void pulse_features::update_template() {
+    if (template_events < template_min_events) {
+        return;
+    }
+    double shape[2 * TEMPLATE_HALF + 1];
+    for (int k = 0; k < 2 * TEMPLATE_HALF + 1; k++) {
+        shape[k] = template_sum[k] / template_events;
+    }
+    set_weights(shape);
+}
+
+//********************************************************************************************
+// The kernel
+//********************************************************************************************
+void pulse_features::process() {
+    const int n = size;
+    float *maxv = max_value.data();
+    int *idx = peak_index.data();
+    float *sum = integral.data();
+    float *ped = pedestal.data();
+    float *a = fit_a.data();
+    float *b = fit_b.data();
+
+    // Max, its position and the integral in one pass over the samples
+    for (int e = 0; e < n; e++) {
+        maxv[e] = samples[e];
+        idx[e] = 0;
+        sum[e] = 0;
+    }
+    for (int s = 0; s < num_samples; s++) {
+        const float *row = samples.data() + (size_t)s * capacity;
+        for (int e = 0; e < n; e++) {
+            float v = row[e];
+            bool larger = v > maxv[e];
+            maxv[e] = larger ? v : maxv[e];
+            idx[e] = larger ? s : idx[e];
+            sum[e] += v - ped[e];
+        }
+    }
+
+    // Template fit around the peak, reading just the window of each event.  The window is
+    // clamped to the samples, near the edges the fit isn't used anyway.
+    const int last_sample = num_samples - 1;
+    for (int e = 0; e < n; e++) {
+        float fa = 0;
+        float fb = 0;
+        for (int k = -WINDOW; k <= WINDOW; k++) {
+            int s = std::min(std::max(idx[e] + k, 0), last_sample);
+            float y = samples[(size_t)s * capacity + e] - ped[e];
+            fa += weight_a[k + WINDOW] * y;
+            fb += weight_b[k + WINDOW] * y;
+        }
+        a[e] = fa;
+        b[e] = fb;
+    }
+
+    const int last_full_window = num_samples - 1 - WINDOW;
+    for (int e = 0; e < n; e++) {
+        amplitude[e] = maxv[e] - ped[e];
+        float tau = a[e] > 0 ? -b[e] / a[e] : 0.f;
+        tau = std::min(std::max(tau, -1.f), 1.f);
+        // Near the edges we don't have the whole window, just use the peak sample
+        bool inside = idx[e] >= WINDOW && idx[e] <= last_full_window;
+        peak_time[e] = inside ? idx[e] + tau : idx[e];
+    }
+    for (int e = 0; e < n; e++) {
+        events[e]->amplitude = amplitude[e];
+        events[e]->integral = integral[e];
+        events[e]->peak_time = peak_time[e];
+        events[e]->peak_sample = idx[e];
+    }
+
+    // Large clean pulses refine the template, aligned on their peak and normalized to 1
+    for (int e = 0; e < n; e++) {
+        if (amplitude[e] < template_min_amplitude || idx[e] < TEMPLATE_HALF || idx[e] > num_samples - 1 - TEMPLATE_HALF) {
+            continue;
+        }
+        int peak = idx[e];
+        for (int k = -TEMPLATE_HALF; k <= TEMPLATE_HALF; k++) {
+            template_sum[k + TEMPLATE_HALF] += (samples[(size_t)(peak + k) * capacity + e] - ped[e]) / amplitude[e];
+        }
+        template_events++;
+    }
+}
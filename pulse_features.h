@@ -0,0 +1,59 @@
+#pragma once
+
+#include "event_builder.h"
+
+#include <cstdint>
+#include <vector>
+
+// Batch feature extraction for completed channel events.
+// Events are copied into a sample major (structure of arrays) buffer, so every step of
+// the kernel is a loop over events that the compiler can vectorize.  For each event we get
+//   amplitude:    max sample - pedestal
+//   peak_sample:  index of the max sample
+//   integral:     sum of (sample - pedestal)
+//   peak_time:    peak sample plus a sub-sample offset from a template fit
+// The time comes from a linearized template fit over the 5 samples around the peak (an
+// optimal filter with white noise): y_k = A T(k - tau) ~ A T_k - A tau T'_k is linear in
+// A and A tau, so both are fixed weighted sums of the samples.  The template starts as a
+// gaussian and is replaced by the average of large pulses once enough have been seen.
+class pulse_features {
+private:
+    static const int WINDOW = 2;            // fit samples peak - WINDOW .. peak + WINDOW
+    static const int TEMPLATE_HALF = WINDOW + 1;
+
+    int num_samples;
+    int capacity;
+    int size;
+
+    std::vector<float> samples;             // [sample * capacity + event]
+    std::vector<float> pedestal;            // [event]
+    std::vector<float> max_value;
+    std::vector<int> peak_index;
+    std::vector<float> fit_a;
+    std::vector<float> fit_b;
+    std::vector<float> amplitude;
+    std::vector<float> integral;
+    std::vector<float> peak_time;
+
+    // Optimal filter weights, A = sum a_k y_k and A tau = -sum b_k y_k
+    float weight_a[2 * WINDOW + 1];
+    float weight_b[2 * WINDOW + 1];
+    std::vector<double> template_sum;       // [k + TEMPLATE_HALF]
+    uint64_t template_events;
+
+    void set_weights(const double *shape);
+
+public:
+    std::vector<single_channel_event*> events;
+
+    pulse_features(int capacity);
+
+    bool full() {return size == capacity;}
+    int get_size() {return size;}
+    void add(single_channel_event *e, float event_pedestal);
+    // Runs the kernel and stores the features in the events
+    void process();
+    void clear() {size = 0; events.clear();}
+    // Rebuild the fit weights from the pulses seen so far, called once per refresh
+    void update_template();
+};
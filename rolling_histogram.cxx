@@ -0,0 +1,75 @@
+#include "rolling_histogram.h"
+
+#include <TH1.h>
+
+#include <algorithm>
+
+rolling_histogram::rolling_histogram(int nx, int xmax, int ny, int ymax, int nwindows, int nslices) {
+    this->nx = nx;
+    this->ny = ny;
+    this->xmax = xmax;
+    this->ymax = ymax;
+    this->nwindows = nwindows;
+    this->nslices = nslices;
+    current = std::vector<int>(nwindows, 0);
+    pending = std::vector<uint32_t>((size_t)nx * ny, 0);
+    has_pending = false;
+    slices = std::vector<std::vector<uint32_t>>(nwindows, std::vector<uint32_t>((size_t)nslices * nx * ny, 0));
+    sums = std::vector<std::vector<uint32_t>>(nwindows, std::vector<uint32_t>((size_t)nx * ny, 0));
+}
+
+void rolling_histogram::flush() {
+    if (!has_pending) {
+        return;
+    }
+    for (int w = 0; w < nwindows; w++) {
+        uint32_t *slice = slices[w].data() + (size_t)current[w] * nx * ny;
+        uint32_t *sum = sums[w].data();
+        for (int i = 0; i < nx * ny; i++) {
+            slice[i] += pending[i];
+            sum[i] += pending[i];
+        }
+    }
+    std::fill(pending.begin(), pending.end(), 0);
+    has_pending = false;
+}
+
+void rolling_histogram::rotate(int window) {
+    // What was filled so far belongs to the slice that's ending
+    flush();
+    // The next slice is the oldest one, take it out of the sum and start filling it from zero
+    current[window] = (current[window] + 1) % nslices;
+    uint32_t *oldest = slices[window].data() + (size_t)current[window] * nx * ny;
+    uint32_t *sum = sums[window].data();
+    for (int i = 0; i < nx * ny; i++) {
+        sum[i] -= oldest[i];
+        oldest[i] = 0;
+    }
+}
+
+void rolling_histogram::reset() {
+    std::fill(pending.begin(), pending.end(), 0);
+    has_pending = false;
+    for (int w = 0; w < nwindows; w++) {
+        std::fill(slices[w].begin(), slices[w].end(), 0);
+        std::fill(sums[w].begin(), sums[w].end(), 0);
+    }
+}
+
+void rolling_histogram::project(int window, TH1 *target) {
+    flush();
+    double entries = 0;
+    auto &sum = sums[window];
+    for (int iy = 0; iy < ny; iy++) {
+        for (int ix = 0; ix < nx; ix++) {
+            double content = sum[iy * nx + ix];
+            if (ny == 1) {
+                target->SetBinContent(ix + 1, content);
+            } else {
+                target->SetBinContent(ix + 1, iy + 1, content);
+            }
+            entries += content;
+        }
+    }
+    target->SetEntries(entries);
+}
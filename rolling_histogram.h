@@ -0,0 +1,47 @@
+#pragma once
+
+#include <TH1.h>
+
+#include <cstdint>
+#include <vector>
+
+// Integer counts for a few sliding time windows of the same histogram.
+// Each window is a ring of slices with a running sum, and rotating swaps the oldest slice out
+// of the sum.  That way drawing a window costs one pass over the bins, no matter how long it is.
+// Filling only bumps one pending bin, the pending counts are added to every window's current
+// slice and sum when a window rotates or is drawn, so a fill costs the same however many
+// windows there are.
+// Time keeping is left to the owner, which calls rotate() when a slice is over.
+class rolling_histogram {
+private:
+    int nx;
+    int ny;
+    int xmax;
+    int ymax;
+    int nslices;
+    int nwindows;
+    std::vector<int> current;                       // [window] slice being filled
+    std::vector<uint32_t> pending;                  // [bin], not in any window yet
+    bool has_pending;
+    std::vector<std::vector<uint32_t>> slices;      // [window][slice * nx * ny + bin]
+    std::vector<std::vector<uint32_t>> sums;        // [window][bin]
+
+public:
+    // nx bins covering [0, xmax), and the same for y.  1D histograms use ny = ymax = 1.
+    rolling_histogram(int nx, int xmax, int ny, int ymax, int nwindows, int nslices);
+
+    void fill(uint32_t x, uint32_t y = 0) {
+        if (x >= (uint32_t)xmax || y >= (uint32_t)ymax) {
+            return;
+        }
+        int bin = (int)((uint64_t)y * ny / ymax) * nx + (int)((uint64_t)x * nx / xmax);
+        pending[bin]++;
+        has_pending = true;
+    }
+    // Move the pending counts into every window
+    void flush();
+    void rotate(int window);
+    void reset();
+    // Copy the window into a TH1/TH2 with nx (x ny) bins
+    void project(int window, TH1 *target);
+};
@@ -0,0 +1,135 @@
+#include "run_header.h"
+
+#include "decompressor.h"
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// The header is a few kB, anything longer than this isn't a header
+static const size_t max_header_bytes = 1 << 16;
+static const std::string header_end = "##################################################";
+
+// A cached header is only used while the file has the same size and modification time, so a
+// run file that is rewritten under the same name gets parsed again
+struct cached_header {
+    off_t size;
+    struct timespec mtime;
+    run_header header;
+};
+static std::map<std::string, cached_header> header_cache;
+
+static int parse_int(const std::string &value) {
+    try {
+        return std::stoi(value);
+    } catch (const std::exception &) {
+        return -1;
+    }
+}
+
+static int header_int(const run_header &header, const char *key) {
+    auto entry = header.entries.find(key);
+    if (entry == header.entries.end()) {
+        return -1;
+    }
+    return parse_int(entry->second);
+}
+
+bool read_run_header(const std::string &fname, run_header &header) {
+    struct stat status;
+    bool have_status = stat(fname.c_str(), &status) == 0;
+    auto cached = header_cache.find(fname);
+    if (have_status && cached != header_cache.end() && cached->second.size == status.st_size
+        && cached->second.mtime.tv_sec == status.st_mtim.tv_sec && cached->second.mtime.tv_nsec == status.st_mtim.tv_nsec) {
+        header = cached->second.header;
+        return true;
+    }
+    std::vector<char> buffer(max_header_bytes);
+    size_t size;
+    if (decompressor::is_compressed(fname)) {
+        decompressor file(fname);
+        if (!file.good()) {
+            return false;
+        }
+        size = file.read(buffer.data(), buffer.size());
+    } else {
+        std::ifstream file(fname, std::ios::in | std::ios::binary);
+        if (!file.good()) {
+            return false;
+        }
+        file.read(buffer.data(), buffer.size());
+        size = file.gcount();
+    }
+
+    header = run_header();
+    header.complete = false;
+    header.data_start = 0;
+    // The first two lines are the opening #s and a title, the header ends at the next line of #s
+    size_t start = 0;
+    for (int line_number = 0; start < size; line_number++) {
+        size_t end = start;
+        while (end < size && buffer[end] != '\n') {
+            end++;
+        }
+        if (end == size) {
+            break;      // Still being written
+        }
+        std::string line(buffer.data() + start, end - start);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        start = end + 1;
+        if (line_number < 2) {
+            continue;
+        }
+        if (line == header_end) {
+            header.complete = true;
+            header.data_start = start;
+            break;
+        }
+        auto delimiter = line.find(':');
+        if (line.rfind("# ", 0) == 0 && delimiter != std::string::npos) {
+            auto value = line.substr(delimiter + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            header.entries[line.substr(2, delimiter - 2)] = value;
+        }
+    }
+
+    header.file_version_major = -1;
+    header.file_version_minor = -1;
+    auto version = header.entries.find("File Version");
+    if (version != header.entries.end()) {
+        auto dot = version->second.find('.');
+        if (dot != std::string::npos) {
+            header.file_version_major = parse_int(version->second.substr(0, dot));
+            header.file_version_minor = parse_int(version->second.substr(dot + 1));
+        }
+    }
+    header.num_kcu = header_int(header, "Number of KCUs");
+    header.num_asic = header_int(header, "Number of ASICs");
+    header.data_coll_enable = header_int(header, "Generator Setting data_coll_enable");
+    header.machine_gun = header_int(header, "Generator Setting machine_gun");
+    header.jumbo_enable = header_int(header, "Generator Setting jumbo_enable");
+
+    // An incomplete header isn't cached, the DAQ may not have finished writing it
+    if (header.complete) {
+        if (have_status) {
+            header_cache[fname] = {status.st_size, status.st_mtim, header};
+        }
+    } else {
+        std::cerr << "No end of header found in " << fname << std::endl;
+    }
+    return true;
+}
+
+std::string find_run_file(const std::string &fname) {
+    for (auto suffix : {"", ".zst", ".gz"}) {
+        std::ifstream file(fname + suffix);
+        if (file.good()) {
+            return fname + suffix;
+        }
+    }
+    return fname;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// The settings block the DAQ writes at the top of every run file, "# Key: value" lines closed
+// by a line of #s.  Anything missing from the header is -1.
+struct run_header {
+    bool complete;              // The closing line was found, so data_start is the first packet
+    uint64_t data_start;        // Byte offset of the first packet
+    int file_version_major;
+    int file_version_minor;
+    int num_kcu;
+    int num_asic;
+    int data_coll_enable;
+    int machine_gun;
+    int jumbo_enable;
+    std::map<std::string, std::string> entries;     // Every "# Key: value" line, key without the "# "
+};
+
+// Parse the header of a run file in one read.  A complete header is cached, so later calls for
+// the same unchanged file (load_configs, the file stream and its index) only stat it.  Returns
+// false if the file can't be opened.
+bool read_run_header(const std::string &fname, run_header &header);
+
+// The run file as it is on disk, RunXXX.h2g or an archived RunXXX.h2g.zst / RunXXX.h2g.gz.
+// Returns fname unchanged if none of them exist.
+std::string find_run_file(const std::string &fname);
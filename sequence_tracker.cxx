@@ -0,0 +1,133 @@
+#include "sequence_tracker.h"
+
+#include <cstring>
+
+// Jumps this far are the DAQ starting over or a stray packet, not loss
+static const int64_t resync_distance = 1 << 20;
+
+sequence_tracker::sequence_tracker(int bits) {
+    this->bits = bits;
+    reset();
+}
+
+void sequence_tracker::reset() {
+    std::memset(&counts, 0, sizeof(counts));
+    expected_before = 0;
+    holes = 0;
+    started = false;
+    std::memset(seen, 0, sizeof(seen));
+}
+
+void sequence_tracker::restart() {
+    if (started) {
+        expected_before += highest - base + 1;
+    }
+    started = false;
+    std::memset(seen, 0, sizeof(seen));
+}
+
+sequence_counts sequence_tracker::get_counts() {
+    auto c = counts;
+    c.outstanding = holes;
+    c.expected = expected_before + (started ? highest - base + 1 : 0);
+    return c;
+}
+
+void sequence_tracker::set_counts(const sequence_counts &c) {
+    counts = c;
+    counts.expected = 0;
+    counts.outstanding = 0;
+    expected_before = c.expected;
+    holes = c.outstanding;
+    started = false;
+    std::memset(seen, 0, sizeof(seen));
+}
+
+//********************************************************************************************
+// Move the top of the window up to n.  Every number passed over either goes straight out of
+// the window (lost) or becomes a hole, and every number pushed out of the bottom that never
+// arrived is lost.  Each number enters and leaves once, so this is O(1) per packet.
+//********************************************************************************************
+void sequence_tracker::advance(uint64_t n) {
+    uint64_t distance = n - highest;
+    if (distance >= WINDOW) {
+        counts.missing += holes + (distance - WINDOW);
+        holes = WINDOW - 1;
+        std::memset(seen, 0, sizeof(seen));
+        highest = n;
+        return;
+    }
+    for (uint64_t k = highest + 1; k <= n; k++) {
+        // k - WINDOW leaves the window, nothing was there before the window first filled up
+        if (k >= base + WINDOW && !is_seen(k)) {
+            counts.missing++;
+            holes--;
+        }
+        clear_seen(k);
+        if (k < n) {
+            holes++;
+        }
+    }
+    highest = n;
+}
+
+sequence_tracker::result sequence_tracker::add(uint32_t packet_number) {
+    uint32_t mask = bits >= 32 ? 0xffffffff : ((uint32_t)1 << bits) - 1;
+    packet_number &= mask;
+    if (!started) {
+        // Whatever the last window didn't see is lost for good
+        counts.missing += holes;
+        holes = 0;
+        started = true;
+        have_candidate = false;
+        base = highest = packet_number;
+        highest_raw = packet_number;
+        set_seen(highest);
+        counts.received++;
+        return IN_ORDER;
+    }
+    // Signed distance from the highest number, modulo the counter width
+    int64_t d = (int64_t)((packet_number - highest_raw) & mask);
+    if (d > (int64_t)(mask / 2)) {
+        d -= (int64_t)mask + 1;
+    }
+    if (d > resync_distance || d < -resync_distance) {
+        // Only start over once the next packet follows this one, a single stray packet would
+        // otherwise throw the window away twice
+        bool follows = have_candidate && ((packet_number - candidate) & mask) - 1 < WINDOW;
+        candidate = packet_number;
+        have_candidate = true;
+        if (!follows) {
+            counts.stale++;
+            return STALE;
+        }
+        restart();
+        return add(packet_number);
+    }
+    have_candidate = false;
+    if (d > 0) {
+        advance(highest + d);
+        highest_raw = packet_number;
+        set_seen(highest);
+        counts.received++;
+        return d == 1 ? IN_ORDER : GAP;
+    }
+    if (d == 0) {
+        counts.duplicate++;
+        return DUPLICATE;
+    }
+    if (-d >= WINDOW || (int64_t)highest + d < (int64_t)base) {
+        counts.stale++;
+        return STALE;
+    }
+    uint64_t n = highest + d;
+    if (is_seen(n)) {
+        counts.duplicate++;
+        return DUPLICATE;
+    }
+    set_seen(n);
+    holes--;
+    counts.late++;
+    counts.received++;
+    return LATE;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+// Totals of one FPGA's packet sequence.  The packets lost so far are missing + outstanding.
+struct sequence_counts {
+    uint64_t expected;      // Packet numbers covered so far
+    uint64_t received;      // Distinct packets
+    uint64_t missing;       // Left the window without arriving, only goes up
+    uint64_t outstanding;   // Not arrived yet but still in the window, a late packet can fill them
+    uint64_t late;          // Arrived after a higher packet number, within the window
+    uint64_t duplicate;
+    uint64_t stale;         // Arrived too late for the window, already counted as missing
+};
+
+// Sorts one FPGA's packets by their packet number into in order, late (reordered) and
+// duplicate, in O(1) per packet.  The last WINDOW packet numbers up to the highest one seen
+// are kept as a bitmap of which have arrived.  A number that leaves the window without
+// arriving is counted as lost.  Packet numbers are `bits` wide and wrap around.
+class sequence_tracker {
+public:
+    static constexpr int WINDOW = 4096;
+
+private:
+    static constexpr int WORDS = WINDOW / 64;
+
+    int bits;
+    bool started;
+    uint64_t base;              // First packet number since the last restart, unwrapped
+    uint64_t highest;           // Unwrapped
+    uint32_t highest_raw;
+    bool have_candidate;        // A packet far from the window, maybe the DAQ started over
+    uint32_t candidate;
+    uint64_t seen[WORDS];       // Bit n % WINDOW is packet number n, for (highest - WINDOW, highest]
+    uint64_t holes;             // Numbers in the window that haven't arrived yet
+    uint64_t expected_before;   // Covered before the last restart
+    sequence_counts counts;     // Without expected and outstanding, those are worked out on demand
+
+    bool is_seen(uint64_t n) {return seen[(n % WINDOW) / 64] >> (n % 64) & 1;}
+    void set_seen(uint64_t n) {seen[(n % WINDOW) / 64] |= (uint64_t)1 << (n % 64);}
+    void clear_seen(uint64_t n) {seen[(n % WINDOW) / 64] &= ~((uint64_t)1 << (n % 64));}
+    void advance(uint64_t n);
+
+public:
+    enum result {IN_ORDER, GAP, LATE, DUPLICATE, STALE};
+
+    sequence_tracker(int bits = 32);
+    void set_bits(int bits) {this->bits = bits;}
+    result add(uint32_t packet_number);
+    // Start over from the next packet without counting the jump as loss, e.g. after a seek
+    void restart();
+    // Forget everything, e.g. for a new run
+    void reset();
+
+    sequence_counts get_counts();
+    uint64_t get_missing() {return counts.missing;}
+    // For checkpoints and for counts reported by another process.  Tracking starts over with
+    // the next packet, the outstanding ones then count as missing.
+    void set_counts(const sequence_counts &c);
+};
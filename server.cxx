@@ -1,5 +1,10 @@
 #include "server.h"
 
+#include "configuration.h"
+#include "metrics.h"
+
+#include <cstring>
+
 server* server::instance = nullptr;
 
 server::server() {
@@ -8,7 +13,32 @@ server::server() {
         port = new char[6];
         strcpy(port, "12345");
     }
-    s = new THttpServer(Form("http:%s;rw;noglobal", port));
+    s = new monitor_http_server(Form("http:%s;rw;noglobal", port));
     s->SetItemField("/", "_monitoring", "1000");
     s->SetItemField("/", "_toptitle", "EEEMCal Online Monitor"); 
 }
+
+void server::set_status(const char *status) {
+    if (status == nullptr || status[0] == '\0') {
+        s->SetItemField("/", "_toptitle", "EEEMCal Online Monitor");
+    } else {
+        s->SetItemField("/", "_toptitle", Form("EEEMCal Online Monitor - %s", status));
+    }
+}
+
+void server::register_object(const char *folder, TObject *obj) {
+    s->Register(folder, obj);
+    registered.emplace_back(folder, obj);
+}
+
+//********************************************************************************************
+// Plain text counters for scrapers, a few hundred bytes instead of whole ROOT objects
+//********************************************************************************************
+void monitor_http_server::MissedRequest(THttpCallArg *arg) {
+    if (strcmp(arg->GetPathName(), "") == 0 && strcmp(arg->GetFileName(), "metrics") == 0) {
+        arg->SetContentType("application/openmetrics-text; version=1.0.0; charset=utf-8");
+        arg->SetContent(metrics::get_instance()->render(configuration::get_instance()->NUM_FPGA));
+        return;
+    }
+    THttpServer::MissedRequest(arg);
+}
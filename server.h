@@ -1,6 +1,20 @@
 #pragma once
 
 #include "THttpServer.h"
+#include "THttpCallArg.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Answers /metrics with the pipeline counters, everything else goes to the usual THttpServer
+class monitor_http_server : public THttpServer {
+protected:
+    void MissedRequest(THttpCallArg *arg) override;
+
+public:
+    monitor_http_server(const char *engine) : THttpServer(engine) {}
+};
 
 class server {
 private:
@@ -11,8 +25,8 @@ private:
 
     static server* instance; // Static pointer to the single instance
     THttpServer *s;
-
-    
+    // Everything registered through register_object, in order, with its folder
+    std::vector<std::pair<std::string, TObject*>> registered;
 
 public:
     static server* get_instance() {
@@ -29,6 +43,15 @@ public:
         return s;
     }
 
+    // Registers obj in the web server and remembers where, so exports can rebuild the same tree
+    void register_object(const char *folder, TObject *obj);
+    const std::vector<std::pair<std::string, TObject*>> &get_registered() {
+        return registered;
+    }
+
+    // Appended to the page title, e.g. to warn shifters the plots are prescaled
+    void set_status(const char *status);
+
     void kill_server() {
         delete s;
     }
@@ -0,0 +1,148 @@
+#include "shm_export.h"
+
+#include "server.h"
+
+#include <TH1.h>
+
+#include <atomic>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <new>
+#include <set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+//********************************************************************************************
+// Lay out the segment from the registered histograms and map it
+//********************************************************************************************
+shm_export::shm_export(const char *name) {
+    this->name = name[0] == '/' ? name : std::string("/") + name;
+    fd = -1;
+    segment = nullptr;
+    size = 0;
+    header = nullptr;
+    objects = nullptr;
+
+    // The same histogram can be registered in more than one folder, the first one wins
+    std::vector<std::string> folders;
+    std::set<TH1*> seen;
+    for (auto &entry : server::get_instance()->get_registered()) {
+        auto hist = dynamic_cast<TH1*>(entry.second);
+        if (hist == nullptr || !seen.insert(hist).second) {
+            continue;
+        }
+        histograms.push_back(hist);
+        folders.push_back(entry.first);
+    }
+
+    uint64_t objects_offset = sizeof(shm_header);
+    uint64_t data_offset = objects_offset + histograms.size() * sizeof(shm_object);
+    size = data_offset;
+    for (auto hist : histograms) {
+        size += hist->GetNcells() * sizeof(float);
+    }
+
+    // Always start a fresh segment, even over one left behind by a crashed monitor.  Viewers
+    // still mapping the old one notice the new one by its inode.
+    shm_unlink(this->name.c_str());
+    fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        std::cerr << "Histogram export to shared memory disabled" << std::endl;
+        return;
+    }
+    if (ftruncate(fd, size) != 0) {
+        perror("ftruncate");
+        std::cerr << "Histogram export to shared memory disabled" << std::endl;
+        close(fd);
+        fd = -1;
+        shm_unlink(this->name.c_str());
+        return;
+    }
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        perror("mmap");
+        std::cerr << "Histogram export to shared memory disabled" << std::endl;
+        close(fd);
+        fd = -1;
+        shm_unlink(this->name.c_str());
+        return;
+    }
+    segment = static_cast<uint8_t*>(mapped);
+    header = new (segment) shm_header();
+    objects = reinterpret_cast<shm_object*>(segment + objects_offset);
+
+    // Fixed part of the layout.  The magic goes in last, readers ignore the segment until then.
+    header->version = SHM_VERSION;
+    header->num_objects = histograms.size();
+    header->total_size = size;
+    header->objects_offset = objects_offset;
+    header->data_offset = data_offset;
+    header->sequence.store(0, std::memory_order_relaxed);
+    header->closed.store(0, std::memory_order_relaxed);
+    header->run_number = 0;
+    header->snapshot_time = 0;
+    uint64_t offset = data_offset;
+    for (size_t i = 0; i < histograms.size(); i++) {
+        auto hist = histograms[i];
+        auto &object = objects[i];
+        std::memset(&object, 0, sizeof(shm_object));
+        strncpy(object.folder, folders[i].c_str(), sizeof(object.folder) - 1);
+        strncpy(object.name, hist->GetName(), sizeof(object.name) - 1);
+        strncpy(object.class_name, hist->ClassName(), sizeof(object.class_name) - 1);
+        object.dimension = hist->GetDimension();
+        TAxis *axes[3] = {hist->GetXaxis(), hist->GetYaxis(), hist->GetZaxis()};
+        for (int a = 0; a < 3; a++) {
+            object.nbins[a] = axes[a]->GetNbins();
+            object.min[a] = axes[a]->GetXmin();
+            object.max[a] = axes[a]->GetXmax();
+        }
+        object.offset = offset;
+        object.num_cells = hist->GetNcells();
+        offset += object.num_cells * sizeof(float);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC));
+    std::cout << "Exporting " << histograms.size() << " histograms (" << size / (1024 * 1024) << " MB) to shared memory " << this->name << std::endl;
+}
+
+shm_export::~shm_export() {
+    if (segment != nullptr) {
+        header->closed.store(1, std::memory_order_release);
+        munmap(segment, size);
+        shm_unlink(name.c_str());
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+//********************************************************************************************
+// Copy the current contents in, bracketed by the sequence lock.  Only this thread writes.
+//********************************************************************************************
+void shm_export::snapshot(int run_number) {
+    if (segment == nullptr) {
+        return;
+    }
+    auto sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header->run_number = run_number;
+    header->snapshot_time = time(nullptr);
+    for (size_t i = 0; i < histograms.size(); i++) {
+        auto hist = histograms[i];
+        auto &object = objects[i];
+        // Titles carry the run number, so they change between runs
+        strncpy(object.title, hist->GetTitle(), sizeof(object.title) - 1);
+        object.entries = hist->GetEntries();
+        auto contents = reinterpret_cast<float*>(segment + object.offset);
+        for (uint64_t bin = 0; bin < object.num_cells; bin++) {
+            contents[bin] = hist->GetBinContent((int) bin);
+        }
+    }
+
+    header->sequence.store(sequence + 2, std::memory_order_release);
+}
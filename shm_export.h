@@ -0,0 +1,31 @@
+#pragma once
+
+#include "shm_layout.h"
+
+#include <TH1.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Publishes every histogram registered with the web server to a POSIX shared memory segment,
+// so a separate process (tools/shm_viewer.cxx) can serve the plots without touching the
+// monitor.  The segment is laid out once, from what's registered when it is created, and each
+// snapshot only copies the bin contents, titles and entry counts under a sequence lock.
+// Canvases and graphs are not exported, the histograms drawn on the canvases are.
+class shm_export {
+private:
+    std::string name;
+    int fd;
+    uint8_t *segment;       // nullptr if the segment couldn't be created
+    uint64_t size;
+    shm_header *header;
+    shm_object *objects;
+    std::vector<TH1*> histograms;
+
+public:
+    shm_export(const char *name);
+    ~shm_export();
+    bool is_open() {return segment != nullptr;}
+    void snapshot(int run_number);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//********************************************************************************************
+// Layout of the shared memory histogram snapshot, written by shm_export and read by
+// tools/shm_viewer.cxx.  Plain structs only, so readers don't need ROOT.
+//
+//   shm_header | shm_object[num_objects] | bin contents (float, under/overflow included)
+//
+// The number of objects, their binning and all offsets are fixed when the segment is created.
+// Everything after the header is rewritten each snapshot under the sequence lock: the writer
+// makes `sequence` odd, copies, and makes it even again.  A reader copies the segment and keeps
+// the copy only if `sequence` was even and unchanged before and after.
+//********************************************************************************************
+constexpr char SHM_MAGIC[8] = "H2GHIST";
+constexpr uint32_t SHM_VERSION = 1;
+
+struct shm_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_objects;
+    uint64_t total_size;                // Bytes in the whole segment
+    uint64_t objects_offset;            // Of the first shm_object
+    uint64_t data_offset;               // Of the first bin content
+    std::atomic<uint64_t> sequence;     // Odd while a snapshot is being written
+    std::atomic<uint32_t> closed;       // Set when the monitor exits, readers should reopen
+    int32_t run_number;
+    int64_t snapshot_time;              // Unix seconds
+};
+
+struct shm_object {
+    char folder[128];                   // Where the monitor's web server shows it
+    char name[64];
+    char title[128];
+    char class_name[16];                // Of the original, e.g. TH1I or TProfile
+    int32_t dimension;
+    int32_t nbins[3];
+    double min[3];
+    double max[3];
+    double entries;
+    uint64_t offset;                    // Of its bin contents, from the start of the segment
+    uint64_t num_cells;                 // ROOT global bins, (nx + 2) * (ny + 2) * (nz + 2)
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence lock needs a lock free counter");
@@ -0,0 +1,149 @@
+#include "shower_reco.h"
+
+#include "configuration.h"
+#include "canvas_manager.h"
+#include "server.h"
+#include "mapping.h"
+
+#include <TCanvas.h>
+#include <TH1.h>
+#include <TH2.h>
+#include <TProfile.h>
+
+#include <algorithm>
+
+shower_reco::shower_reco(int run_number, int capacity) {
+    auto config = configuration::get_instance();
+    auto geo = geometry::get_instance();
+    this->capacity = capacity;
+    num_layers = geo->get_num_layers();
+    num_fpga = config->NUM_FPGA;
+    per_fpga = config->NUM_ASIC * config->NUM_CHANNELS;
+    threshold = config->RECO_CHANNEL_THRESHOLD;
+
+    channel_layer = std::vector<int>(geo->get_num_channels(), -1);
+    channel_x = std::vector<float>(geo->get_num_channels(), 0);
+    channel_y = std::vector<float>(geo->get_num_channels(), 0);
+    for (int i = 0; i < geo->get_num_channels(); i++) {
+        auto &cell = geo->get(i);
+        if (cell.cell < 0) {
+            continue;
+        }
+        channel_layer[i] = cell.layer;
+        // Cell centres
+        channel_x[i] = cell.x + 0.5;
+        channel_y[i] = cell.y + 0.5;
+    }
+
+    size = 0;
+    energy = std::vector<float>(capacity, 0);
+    layer_energy = std::vector<float>((size_t)capacity * num_layers, 0);
+    cog_x = std::vector<float>(capacity, 0);
+    cog_y = std::vector<float>(capacity, 0);
+    cog_z = std::vector<float>(capacity, 0);
+    hits = std::vector<int>(capacity, 0);
+
+    int num_x = geo->get_num_x();
+    int num_y = geo->get_num_y();
+    energy_sum = new TH1D("shower_energy_sum", Form("Run %03d Energy Sum;Sum of amplitudes (ADC);Events", run_number), 1000, 0, 16 * config->MAX_ADC);
+    hit_count = new TH1D("shower_hits", Form("Run %03d Channels over Threshold;Channels;Events", run_number), geo->get_num_channels(), 0, geo->get_num_channels());
+    longitudinal_profile = new TProfile("shower_longitudinal_profile", Form("Run %03d Longitudinal Profile;Layer;Mean amplitude (ADC)", run_number), num_layers, 0, num_layers);
+    cog_xy = new TH2D("shower_cog_xy", Form("Run %03d Centre of Gravity;x (cells);y (cells)", run_number), 10 * num_x, 0, num_x, 10 * num_y, 0, num_y);
+    cog_layer = new TH1D("shower_cog_layer", Form("Run %03d Shower Depth;Layer;Events", run_number), 4 * num_layers, 0, num_layers);
+
+    auto s = server::get_instance();
+    auto canvases = canvas_manager::get_instance();
+    auto canvas_id = canvases.new_canvas("shower_summary", Form("Run %03d Shower Summary", run_number), 1200, 800);
+    auto c = canvases.get_canvas(canvas_id);
+    s->register_object("/Shower", c);
+    s->register_object("/Shower", energy_sum);
+    s->register_object("/Shower", hit_count);
+    s->register_object("/Shower", longitudinal_profile);
+    s->register_object("/Shower", cog_xy);
+    s->register_object("/Shower", cog_layer);
+    c->Divide(2, 2);
+    c->cd(1);
+    energy_sum->Draw();
+    gPad->SetLogy();
+    c->cd(2);
+    longitudinal_profile->Draw();
+    c->cd(3);
+    cog_xy->Draw("colz");
+    c->cd(4);
+    cog_layer->Draw();
+}
+
+shower_reco::~shower_reco() {
+}
+
+void shower_reco::process(event_thunderdome &thunderdome) {
+    int n = thunderdome.get_num_events();
+    for (int i = 0; i < n; i++) {
+        accumulate(thunderdome.get_event(i));
+        if (size == capacity) {
+            fill_histograms();
+        }
+    }
+    fill_histograms();
+}
+
+void shower_reco::accumulate(std::vector<kcu_event> &event) {
+    float *layers = layer_energy.data() + (size_t)size * num_layers;
+    std::fill(layers, layers + num_layers, 0.f);
+    float sum = 0, x = 0, y = 0, z = 0;
+    int n = 0;
+    for (auto &kcu : event) {
+        if (kcu.get_fpga_id() >= num_fpga) {
+            continue;
+        }
+        int offset = kcu.get_fpga_id() * per_fpga;
+        for (int channel = 0; channel < per_fpga; channel++) {
+            auto c = kcu.get_channel(channel);
+            int global = offset + channel;
+            if (c == nullptr || channel_layer[global] < 0) {
+                continue;
+            }
+            float a = c->get_amplitude();
+            if (a < threshold) {
+                continue;
+            }
+            sum += a;
+            layers[channel_layer[global]] += a;
+            x += a * channel_x[global];
+            y += a * channel_y[global];
+            z += a * (channel_layer[global] + 0.5f);
+            n++;
+        }
+    }
+    energy[size] = sum;
+    hits[size] = n;
+    cog_x[size] = sum > 0 ? x / sum : 0;
+    cog_y[size] = sum > 0 ? y / sum : 0;
+    cog_z[size] = sum > 0 ? z / sum : 0;
+    size++;
+}
+
+void shower_reco::fill_histograms() {
+    for (int i = 0; i < size; i++) {
+        energy_sum->Fill(energy[i]);
+        hit_count->Fill(hits[i]);
+        if (energy[i] <= 0) {
+            continue;
+        }
+        cog_xy->Fill(cog_x[i], cog_y[i]);
+        cog_layer->Fill(cog_z[i]);
+        const float *layers = layer_energy.data() + (size_t)i * num_layers;
+        for (int l = 0; l < num_layers; l++) {
+            longitudinal_profile->Fill(l, layers[l]);
+        }
+    }
+    size = 0;
+}
+
+void shower_reco::reset() {
+    energy_sum->Reset("ICESM");
+    hit_count->Reset("ICESM");
+    longitudinal_profile->Reset("ICESM");
+    cog_xy->Reset("ICESM");
+    cog_layer->Reset("ICESM");
+}
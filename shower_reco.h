@@ -0,0 +1,52 @@
+#pragma once
+
+#include "event_builder.h"
+
+#include <vector>
+
+#include <TH1.h>
+#include <TH2.h>
+#include <TProfile.h>
+
+// Shower summary of every event aligned across the FPGAs: energy sum, energy per layer and
+// centre of gravity, with positions from the geometry tables.  Events are handled a batch
+// at a time into preallocated per event arrays, then histogrammed in a second pass.
+// Energies are pulse amplitudes over pedestal, in ADC counts, with no calibration.
+class shower_reco {
+private:
+    int capacity;
+    int num_layers;
+    int per_fpga;
+    int num_fpga;
+    float threshold;
+
+    // Copied out of the geometry, [global channel]
+    std::vector<int> channel_layer;     // -1 if not connected
+    std::vector<float> channel_x;
+    std::vector<float> channel_y;
+
+    // Current batch, [event] or [event * num_layers + layer]
+    int size;
+    std::vector<float> energy;
+    std::vector<float> layer_energy;
+    std::vector<float> cog_x;
+    std::vector<float> cog_y;
+    std::vector<float> cog_z;
+    std::vector<int> hits;
+
+    TH1 *energy_sum;
+    TH1 *hit_count;
+    TProfile *longitudinal_profile;
+    TH2 *cog_xy;
+    TH1 *cog_layer;
+
+    void accumulate(std::vector<kcu_event> &event);
+    void fill_histograms();
+
+public:
+    shower_reco(int run_number, int capacity);
+    ~shower_reco();
+
+    void process(event_thunderdome &thunderdome);
+    void reset();
+};
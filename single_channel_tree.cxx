@@ -17,5 +17,9 @@ single_channel_tree::single_channel_tree() {
     tree->Branch("pedestal", &pedestal);
     tree->Branch("ToA", &ToA);
     tree->Branch("ToT", &ToT);
+    tree->Branch("amplitude", &amplitude);
+    tree->Branch("integral", &integral);
+    tree->Branch("peak_time", &peak_time);
+    tree->Branch("peak_sample", &peak_sample);
     tree->Branch("samples", samples, "samples[num_samples]/I");
 }
@@ -37,5 +37,9 @@ public:
     int pedestal;
     int ToA;
     int ToT;
+    float amplitude;
+    float integral;
+    float peak_time;
+    int peak_sample;
     int *samples;
 };
@@ -0,0 +1,87 @@
+#include "timeseries.h"
+
+#include <TGraph.h>
+
+#include <cmath>
+
+// About an hour of raw points at the usual 5 s refresh, then 12 hours of minutes and a week
+// of quarter hours
+const double timeseries::bucket_seconds[NUM_LEVELS] = {0, 60, 900};
+const int timeseries::level_size[NUM_LEVELS] = {720, 720, 672};
+
+timeseries::timeseries(TGraph *graph, statistic shown) {
+    this->graph = graph;
+    this->shown = shown;
+    for (int l = 0; l < NUM_LEVELS; l++) {
+        levels[l].resize(level_size[l]);
+    }
+    clear();
+}
+
+void timeseries::clear() {
+    for (int l = 0; l < NUM_LEVELS; l++) {
+        newest[l] = -1;
+        filled[l] = 0;
+    }
+}
+
+const timeseries::bucket &timeseries::get(int level, int age) const {
+    int size = level_size[level];
+    return levels[level][(newest[level] - age + size) % size];
+}
+
+double timeseries::value(int level, const bucket &b) const {
+    if (shown == MIN) return b.min;
+    if (shown == MAX) return b.max;
+    return b.sum / b.count;
+}
+
+//********************************************************************************************
+// Every level sees every point: the raw level keeps it, the others merge it into their
+// newest bucket or start a new one, dropping their oldest once the ring is full
+//********************************************************************************************
+void timeseries::add(double time, double value) {
+    if (!std::isfinite(value)) {
+        return;
+    }
+    for (int l = 0; l < NUM_LEVELS; l++) {
+        double start = bucket_seconds[l] > 0 ? std::floor(time / bucket_seconds[l]) * bucket_seconds[l] : time;
+        if (filled[l] > 0 && bucket_seconds[l] > 0 && get(l, 0).start == start) {
+            auto &b = levels[l][newest[l]];
+            b.min = std::min(b.min, value);
+            b.max = std::max(b.max, value);
+            b.sum += value;
+            b.count++;
+            continue;
+        }
+        newest[l] = (newest[l] + 1) % level_size[l];
+        if (filled[l] < level_size[l]) {
+            filled[l]++;
+        }
+        levels[l][newest[l]] = {start, value, value, value, 1};
+    }
+    rebuild();
+}
+
+//********************************************************************************************
+// Oldest first: the coarse buckets from before the finer levels start, then the finer ones
+//********************************************************************************************
+void timeseries::rebuild() {
+    int n = 0;
+    double covered_from[NUM_LEVELS];    // Start of the oldest bucket of each level
+    for (int l = 0; l < NUM_LEVELS; l++) {
+        covered_from[l] = filled[l] > 0 ? get(l, filled[l] - 1).start : 0;
+    }
+    graph->Set(0);
+    for (int l = NUM_LEVELS - 1; l >= 0; l--) {
+        // Only the part of this level the next finer one doesn't reach back to
+        double until = l > 0 && filled[l - 1] > 0 ? covered_from[l - 1] : INFINITY;
+        for (int age = filled[l] - 1; age >= 0; age--) {
+            auto &b = get(l, age);
+            if (b.start + bucket_seconds[l] > until) {
+                break;
+            }
+            graph->SetPoint(n++, b.start + bucket_seconds[l] / 2, value(l, b));
+        }
+    }
+}
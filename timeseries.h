@@ -0,0 +1,44 @@
+#pragma once
+
+#include <TGraph.h>
+
+#include <cstdint>
+#include <vector>
+
+// Fixed size history of one value over time, round robin database style.  The newest points
+// are kept as they are, older ones are merged into 1 minute and then 15 minute buckets, each
+// level in its own ring.  Every bucket keeps the min, max and mean of its points.  The graph is
+// rebuilt from the rings on every add, so it never has more than a couple thousand points, no
+// matter how long the run.
+class timeseries {
+public:
+    // What the graph shows for a merged bucket
+    enum statistic {MEAN, MIN, MAX};
+
+private:
+    struct bucket {
+        double start;
+        double min;
+        double max;
+        double sum;
+        uint32_t count;
+    };
+    static constexpr int NUM_LEVELS = 3;
+    static const double bucket_seconds[NUM_LEVELS];     // 0 for the raw points
+    static const int level_size[NUM_LEVELS];
+
+    TGraph *graph;
+    statistic shown;
+    std::vector<bucket> levels[NUM_LEVELS];
+    int newest[NUM_LEVELS];     // Ring index of the newest bucket
+    int filled[NUM_LEVELS];
+
+    const bucket &get(int level, int age) const;    // Age 0 is the newest
+    double value(int level, const bucket &b) const;
+    void rebuild();
+
+public:
+    timeseries(TGraph *graph, statistic shown = MEAN);
+    void add(double time, double value);
+    void clear();
+};
@@ -0,0 +1,166 @@
+/*
+Copies a recorded run into DATA_DIRECTORY as if the DAQ were writing it, to test following a
+live run without beam.
+    h2g_replay RunXXX.h2g new_run_number [mode] [packet size]
+The header block is written in one go, the packets are then appended at the pace set by mode:
+    realtime    follow the heartbeat times (default)
+    xN          N times faster than real time, e.g. x4
+    N           N MB/s
+    max         as fast as possible
+The output file must not exist yet.  Build with `make tools`.
+*/
+
+#include "run_header.h"
+#include "decompressor.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Heartbeat seconds and milliseconds, little endian after the #### marker
+static bool heartbeat_time(const uint8_t *packet, double &seconds) {
+    if (packet[0] != 0x23 || packet[1] != 0x23 || packet[2] != 0x23 || packet[3] != 0x23) {
+        return false;
+    }
+    uint32_t s = packet[12] | (packet[13] << 8) | (packet[14] << 16) | ((uint32_t)packet[15] << 24);
+    uint32_t ms = packet[16] | (packet[17] << 8) | (packet[18] << 16) | ((uint32_t)packet[19] << 24);
+    seconds = s + ms / 1000.;
+    return true;
+}
+
+static bool write_all(int fd, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        auto n = write(fd, data, size);
+        if (n < 0) {
+            perror("write");
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " RunXXX.h2g new_run_number [realtime | xN | MB/s | max] [packet size]" << std::endl;
+        return 1;
+    }
+    std::string mode = argc > 3 ? argv[3] : "realtime";
+    int packet_size = argc > 4 ? std::atoi(argv[4]) : 1452;
+    double speed = 0;       // Times real time, 0 if not following the heartbeats
+    double mb_per_s = 0;    // 0 if not at a fixed rate
+    if (mode == "realtime") {
+        speed = 1;
+    } else if (mode[0] == 'x') {
+        speed = std::atof(mode.c_str() + 1);
+    } else if (mode != "max") {
+        mb_per_s = std::atof(mode.c_str());
+    }
+    if ((mode[0] == 'x' && speed <= 0) || (mode != "max" && speed == 0 && mb_per_s <= 0)) {
+        std::cerr << "Bad mode " << mode << std::endl;
+        return 1;
+    }
+
+    std::ifstream input(argv[1], std::ios::in | std::ios::binary);
+    if (!input.good()) {
+        std::cerr << "Could not open " << argv[1] << std::endl;
+        return 1;
+    }
+    auto dir = getenv("DATA_DIRECTORY");
+    char output_name[4096];
+    snprintf(output_name, sizeof(output_name), "%s/Run%03d.h2g", dir != nullptr ? dir : ".", std::atoi(argv[2]));
+    int fd = open(output_name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        perror(output_name);
+        return 1;
+    }
+
+    run_header run;
+    if (decompressor::is_compressed(argv[1])) {
+        std::cerr << "Decompress " << argv[1] << " first" << std::endl;
+        return 1;
+    }
+    if (!read_run_header(argv[1], run) || !run.complete) {
+        std::cerr << "No header found in " << argv[1] << std::endl;
+        return 1;
+    }
+    // The header goes in as one write, so load_configs never sees half of it
+    std::vector<uint8_t> header(run.data_start);
+    input.read(reinterpret_cast<char*>(header.data()), header.size());
+    if (!write_all(fd, header.data(), header.size())) {
+        return 1;
+    }
+    std::cout << "Writing " << output_name << ", " << mode << std::endl;
+
+    // Written in chunks of up to 64 packets, cut short at every heartbeat so those go out on time
+    const int chunk_packets = 64;
+    std::vector<uint8_t> chunk(chunk_packets * packet_size);
+    int in_chunk = 0;
+    uint64_t bytes = 0;
+    double first_heartbeat = -1;
+    auto start = std::chrono::steady_clock::now();
+    auto last_report = start;
+    uint64_t last_report_bytes = 0;
+    while (true) {
+        uint8_t *packet = chunk.data() + in_chunk * packet_size;
+        if (!input.read(reinterpret_cast<char*>(packet), packet_size)) {
+            break;
+        }
+        double seconds;
+        bool heartbeat = heartbeat_time(packet, seconds);
+        if (heartbeat && speed > 0) {
+            // Everything before this heartbeat is due now, the heartbeat itself when its time comes
+            if (!write_all(fd, chunk.data(), in_chunk * packet_size)) {
+                return 1;
+            }
+            bytes += in_chunk * packet_size;
+            memmove(chunk.data(), packet, packet_size);
+            in_chunk = 0;
+            packet = chunk.data();
+            if (first_heartbeat < 0) {
+                first_heartbeat = seconds;
+                start = std::chrono::steady_clock::now();
+            }
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((seconds - first_heartbeat) / speed)));
+        }
+        in_chunk++;
+        if (in_chunk < chunk_packets && !heartbeat) {
+            continue;
+        }
+        if (!write_all(fd, chunk.data(), in_chunk * packet_size)) {
+            return 1;
+        }
+        bytes += in_chunk * packet_size;
+        in_chunk = 0;
+        if (mb_per_s > 0) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(bytes / (mb_per_s * 1e6))));
+        }
+        auto now = std::chrono::steady_clock::now();
+        double since_report = std::chrono::duration<double>(now - last_report).count();
+        if (since_report >= 5) {
+            std::cout << bytes / 1e6 << " MB written, " << (bytes - last_report_bytes) / since_report / 1e6 << " MB/s" << std::endl;
+            last_report = now;
+            last_report_bytes = bytes;
+        }
+    }
+    if (!write_all(fd, chunk.data(), in_chunk * packet_size)) {
+        return 1;
+    }
+    bytes += in_chunk * packet_size;
+    close(fd);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Wrote " << bytes / 1e6 << " MB of packets in " << seconds << " s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,253 @@
+/*
+Serves the histograms a running monitor exports to shared memory (SHM_EXPORT in the config file)
+from a separate process, under the same folders as the monitor's own web server.
+    shm_viewer /segment_name [port]
+The port defaults to 12346.  The viewer only reads the segment, so any number of them can run
+next to the monitor, and restarting or crashing one doesn't affect it.  When the monitor is
+restarted the viewer picks up the new segment by itself.  Build with `make viewer`.
+*/
+
+#include "shm_layout.h"
+
+#include <TH1.h>
+#include <TH2.h>
+#include <TH3.h>
+#include <THttpServer.h>
+#include <TSystem.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static bool stop = false;
+static void signal_handler(int signal) {
+    stop = true;
+}
+
+class shm_reader {
+private:
+    std::string name;
+    int fd;
+    const uint8_t *segment;
+    uint64_t size;
+    ino_t inode;
+    uint64_t last_sequence;
+    std::chrono::steady_clock::time_point last_change;
+    std::vector<uint8_t> copy;
+
+    THttpServer *server;
+    std::vector<TH1*> histograms;
+    std::vector<TArrayF*> contents;     // The same histograms, as their bin arrays
+
+    bool open_segment();
+    void close_segment();
+    bool replaced();
+    bool copy_snapshot();
+    void publish();
+
+public:
+    shm_reader(const char *name, THttpServer *server);
+    ~shm_reader() {close_segment();}
+    void poll();
+};
+
+shm_reader::shm_reader(const char *name, THttpServer *server) {
+    this->name = name[0] == '/' ? name : std::string("/") + name;
+    this->server = server;
+    fd = -1;
+    segment = nullptr;
+    size = 0;
+    inode = 0;
+    last_sequence = 0;
+}
+
+//********************************************************************************************
+// Map the segment and build a histogram for every object in it
+//********************************************************************************************
+bool shm_reader::open_segment() {
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(shm_header)) {
+        close_segment();
+        return false;
+    }
+    auto mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        perror("mmap");
+        close_segment();
+        return false;
+    }
+    segment = static_cast<const uint8_t*>(mapped);
+    size = st.st_size;
+    inode = st.st_ino;
+
+    // The monitor writes the magic last, so until it's there the layout isn't either
+    auto header = reinterpret_cast<const shm_header*>(segment);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (std::memcmp(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC)) != 0) {
+        close_segment();
+        return false;
+    }
+    if (header->version != SHM_VERSION || header->total_size != size) {
+        std::cerr << "Shared memory " << name << " has layout version " << header->version << ", this viewer reads " << SHM_VERSION << std::endl;
+        close_segment();
+        return false;
+    }
+
+    auto objects = reinterpret_cast<const shm_object*>(segment + header->objects_offset);
+    for (uint32_t i = 0; i < header->num_objects; i++) {
+        auto &object = objects[i];
+        TH1 *hist;
+        TArrayF *array;
+        if (object.dimension == 3) {
+            auto h = new TH3F(object.name, object.name, object.nbins[0], object.min[0], object.max[0], object.nbins[1], object.min[1], object.max[1], object.nbins[2], object.min[2], object.max[2]);
+            hist = h;
+            array = h;
+        } else if (object.dimension == 2) {
+            auto h = new TH2F(object.name, object.name, object.nbins[0], object.min[0], object.max[0], object.nbins[1], object.min[1], object.max[1]);
+            hist = h;
+            array = h;
+        } else {
+            auto h = new TH1F(object.name, object.name, object.nbins[0], object.min[0], object.max[0]);
+            hist = h;
+            array = h;
+        }
+        hist->SetDirectory(nullptr);
+        server->Register(object.folder, hist);
+        histograms.push_back(hist);
+        contents.push_back(array);
+    }
+    copy.resize(size);
+    last_sequence = 0;
+    last_change = std::chrono::steady_clock::now();
+    std::cout << "Serving " << histograms.size() << " histograms from " << name << std::endl;
+    return true;
+}
+
+void shm_reader::close_segment() {
+    for (auto hist : histograms) {
+        server->Unregister(hist);
+        delete hist;
+    }
+    histograms.clear();
+    contents.clear();
+    if (segment != nullptr) {
+        munmap(const_cast<uint8_t*>(segment), size);
+        segment = nullptr;
+    }
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+// A monitor that crashed never marks its segment closed, but its replacement creates a new one
+bool shm_reader::replaced() {
+    int new_fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (new_fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool changed = fstat(new_fd, &st) == 0 && st.st_ino != inode;
+    close(new_fd);
+    return changed;
+}
+
+//********************************************************************************************
+// Take a consistent copy of the segment.  Retried while the monitor is in the middle of a
+// snapshot, which only takes a few tens of milliseconds.
+//********************************************************************************************
+bool shm_reader::copy_snapshot() {
+    auto header = reinterpret_cast<const shm_header*>(segment);
+    for (int attempt = 0; attempt < 200; attempt++) {
+        auto before = header->sequence.load(std::memory_order_acquire);
+        if (before == last_sequence) {
+            return false;
+        }
+        if (before % 2 == 1) {
+            usleep(1000);
+            continue;
+        }
+        std::memcpy(copy.data(), segment, size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == before) {
+            last_sequence = before;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Copy the snapshot into the served histograms
+void shm_reader::publish() {
+    auto header = reinterpret_cast<const shm_header*>(copy.data());
+    auto objects = reinterpret_cast<const shm_object*>(copy.data() + header->objects_offset);
+    for (size_t i = 0; i < histograms.size(); i++) {
+        auto &object = objects[i];
+        std::memcpy(contents[i]->GetArray(), copy.data() + object.offset, object.num_cells * sizeof(float));
+        histograms[i]->SetTitle(object.title);
+        histograms[i]->SetEntries(object.entries);
+    }
+    char snapshot_time[32];
+    time_t t = header->snapshot_time;
+    strftime(snapshot_time, sizeof(snapshot_time), "%H:%M:%S", localtime(&t));
+    server->SetItemField("/", "_toptitle", Form("EEEMCal Online Monitor (viewer) - Run %03d at %s", header->run_number, snapshot_time));
+}
+
+void shm_reader::poll() {
+    if (segment == nullptr && !open_segment()) {
+        return;
+    }
+    auto header = reinterpret_cast<const shm_header*>(segment);
+    auto now = std::chrono::steady_clock::now();
+    if (header->closed.load(std::memory_order_acquire) || (now - last_change > std::chrono::seconds(10) && replaced())) {
+        std::cout << "Monitor restarted, reopening " << name << std::endl;
+        close_segment();
+        return;
+    }
+    if (copy_snapshot()) {
+        last_change = now;
+        publish();
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " /segment_name [port]" << std::endl;
+        return 1;
+    }
+    signal(SIGINT, signal_handler);
+    const char *port = argc > 2 ? argv[2] : "12346";
+    // Read only, the commands of the monitor's own server don't exist here
+    auto server = new THttpServer(Form("http:%s;noglobal", port));
+    server->SetItemField("/", "_monitoring", "1000");
+    server->SetItemField("/", "_toptitle", "EEEMCal Online Monitor (viewer) - waiting for the monitor");
+    shm_reader reader(argv[1], server);
+
+    auto last_poll = std::chrono::steady_clock::now() - std::chrono::seconds(1);
+    while (!stop) {
+        server->ProcessRequests();
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_poll >= std::chrono::seconds(1)) {
+            reader.poll();
+            last_poll = now;
+        }
+        gSystem->Sleep(10);
+    }
+    delete server;
+    return 0;
+}
@@ -0,0 +1,100 @@
+/*
+Replays the packets of a run file over UDP, to test the monitor's UDP input without the DAQ.
+    udp_replay RunXXX.h2g [port] [host] [packets per second] [packet size]
+A rate of 0 sends as fast as possible.  Build with `make tools`.
+*/
+
+#include "run_header.h"
+#include "decompressor.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " RunXXX.h2g [port] [host] [packets per second] [packet size]" << std::endl;
+        return 1;
+    }
+    int port = argc > 2 ? std::atoi(argv[2]) : 11000;
+    const char *host = argc > 3 ? argv[3] : "127.0.0.1";
+    double rate = argc > 4 ? std::atof(argv[4]) : 0;
+    int packet_size = argc > 5 ? std::atoi(argv[5]) : 1452;
+    const int batch_size = 64;
+
+    std::ifstream file(argv[1], std::ios::in | std::ios::binary);
+    if (!file.good()) {
+        std::cerr << "Could not open " << argv[1] << std::endl;
+        return 1;
+    }
+    run_header header;
+    if (decompressor::is_compressed(argv[1])) {
+        std::cerr << "Decompress " << argv[1] << " first" << std::endl;
+        return 1;
+    }
+    if (!read_run_header(argv[1], header) || !header.complete) {
+        std::cerr << "No header found in " << argv[1] << std::endl;
+        return 1;
+    }
+    file.seekg(header.data_start, std::ios::beg);
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (fd < 0 || inet_pton(AF_INET, host, &address.sin_addr) != 1 || connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+        perror("Opening socket");
+        return 1;
+    }
+
+    std::vector<uint8_t> buffer(batch_size * packet_size);
+    std::vector<mmsghdr> messages(batch_size);
+    std::vector<iovec> iovecs(batch_size);
+    for (int i = 0; i < batch_size; i++) {
+        iovecs[i].iov_base = buffer.data() + i * packet_size;
+        iovecs[i].iov_len = packet_size;
+        memset(&messages[i], 0, sizeof(mmsghdr));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint64_t sent = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (true) {
+        file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        int packets = file.gcount() / packet_size;
+        if (packets == 0) {
+            break;
+        }
+        for (int done = 0; done < packets;) {
+            int n = sendmmsg(fd, messages.data() + done, packets - done, 0);
+            if (n < 0) {
+                perror("sendmmsg");
+                return 1;
+            }
+            done += n;
+        }
+        sent += packets;
+        if (rate > 0) {
+            // Keep to the average rate, sleeping off whatever we are ahead by
+            auto due = start + std::chrono::duration<double>(sent / rate);
+            std::this_thread::sleep_until(due);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Sent " << sent << " packets in " << seconds << " s" << std::endl;
+    close(fd);
+    return 0;
+}
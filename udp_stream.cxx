@@ -0,0 +1,212 @@
+#include "udp_stream.h"
+
+#include "configuration.h"
+#include "canvas_manager.h"
+#include "server.h"
+
+#include <TROOT.h>
+#include <TCanvas.h>
+#include <TAxis.h>
+#include <TDatime.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/sock_diag.h>
+#endif
+
+//********************************************************************************************
+// Setup the socket and the batch buffers
+//********************************************************************************************
+udp_stream::udp_stream(int port) {
+    auto config = configuration::get_instance();
+    fd = -1;
+    batch_size = config->UDP_BATCH > 0 ? config->UDP_BATCH : 1;
+    batch_received = 0;
+    batch_next = 0;
+    kernel_drops = 0;
+    bad_size = 0;
+    packets_received = 0;
+
+    auto canvases = canvas_manager::get_instance();
+    auto s = server::get_instance();
+    auto canvas_id = canvases.new_canvas("UDP_Receive", "UDP Receive", 1200, 800);
+    s->register_object("/QA Plots/DAQ Performance", canvases.get_canvas(canvas_id));
+    kernel_drop_graph = new TGraph();
+    kernel_drop_graph->SetName("udp_kernel_drops");
+    gROOT->Add(kernel_drop_graph);
+    // Counters only go up, so the last value of a bucket is its max
+    kernel_drop_series = new timeseries(kernel_drop_graph, timeseries::MAX);
+    kernel_drop_graph->SetTitle("Packets Dropped by the Kernel (Socket Buffer Full)");
+    kernel_drop_graph->GetXaxis()->SetTitle("Time");
+    kernel_drop_graph->GetXaxis()->SetTimeDisplay(1);
+    kernel_drop_graph->GetXaxis()->SetTimeFormat("%H:%M:%S");
+    kernel_drop_graph->GetYaxis()->SetTitle("Dropped Packets");
+    kernel_drop_graph->SetLineColor(kRed);
+    kernel_drop_graph->SetLineWidth(2);
+    kernel_drop_graph->Draw("AL");
+
+#ifdef __linux__
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        throw std::runtime_error("Error opening UDP socket");
+    }
+    // A big buffer rides out the refreshes, when nothing reads the socket for a while.  FORCE
+    // can go past net.core.rmem_max but needs privileges, so fall back to the capped version.
+    int requested = config->UDP_RCVBUF_MB * 1024 * 1024;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &requested, sizeof(requested)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &requested, sizeof(requested));
+    }
+    int actual = 0;
+    socklen_t length = sizeof(actual);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &actual, &length);
+    // The kernel reports double what it was asked for, to account for its bookkeeping
+    if (actual / 2 < requested) {
+        std::cerr << "UDP receive buffer is only " << actual / 2 / 1024 << " kB, raise net.core.rmem_max to get " << config->UDP_RCVBUF_MB << " MB" << std::endl;
+    }
+    // Have the kernel tell us how many packets it dropped with every batch
+    int enable = 1;
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, config->UDP_BIND_ADDRESS.c_str(), &address.sin_addr) != 1) {
+        std::cerr << "Bad UDP_BIND_ADDRESS " << config->UDP_BIND_ADDRESS << std::endl;
+        close(fd);
+        throw std::runtime_error("Error opening UDP socket");
+    }
+    if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+        perror("bind");
+        close(fd);
+        throw std::runtime_error("Error opening UDP socket");
+    }
+    std::cout << "Listening for packets on " << config->UDP_BIND_ADDRESS << ":" << port << std::endl;
+
+    batch_buffer = std::vector<uint8_t>(batch_size * config->PACKET_SIZE);
+    messages = std::vector<mmsghdr>(batch_size);
+    iovecs = std::vector<iovec>(batch_size);
+    control = std::vector<char>(batch_size * CMSG_SPACE(sizeof(uint32_t)));
+    for (int i = 0; i < batch_size; i++) {
+        iovecs[i].iov_base = batch_buffer.data() + i * config->PACKET_SIZE;
+        iovecs[i].iov_len = config->PACKET_SIZE;
+        memset(&messages[i], 0, sizeof(mmsghdr));
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+#else
+    throw std::runtime_error("UDP input needs Linux");
+#endif
+}
+
+udp_stream::~udp_stream() {
+    print_packet_numbers();
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    delete kernel_drop_series;
+    delete kernel_drop_graph;
+}
+
+
+//********************************************************************************************
+// Reading packets
+//********************************************************************************************
+bool udp_stream::receive_batch() {
+#ifdef __linux__
+    size_t control_size = CMSG_SPACE(sizeof(uint32_t));
+    for (int i = 0; i < batch_size; i++) {
+        // The kernel overwrites these on every call
+        messages[i].msg_hdr.msg_control = control.data() + i * control_size;
+        messages[i].msg_hdr.msg_controllen = control_size;
+        messages[i].msg_hdr.msg_flags = 0;
+    }
+    int received = recvmmsg(fd, messages.data(), batch_size, MSG_DONTWAIT, nullptr);
+    if (received <= 0) {
+        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("recvmmsg");
+        }
+        return false;
+    }
+    // The drop counter is a running total for the socket, the newest packet has the latest value
+    auto &last = messages[received - 1].msg_hdr;
+    for (auto cmsg = CMSG_FIRSTHDR(&last); cmsg != nullptr; cmsg = CMSG_NXTHDR(&last, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            kernel_drops = drops;
+        }
+    }
+    batch_received = received;
+    batch_next = 0;
+    packets_received += received;
+    return true;
+#else
+    return false;
+#endif
+}
+
+int udp_stream::read_packet(uint8_t *buffer) {
+#ifdef __linux__
+    auto packet_size = configuration::get_instance()->PACKET_SIZE;
+    while (true) {
+        if (batch_next >= batch_received && !receive_batch()) {
+            return 0;
+        }
+        int i = batch_next++;
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            bad_size++;
+            continue;
+        }
+        // Short datagrams (heartbeats from some firmware) are padded to a full packet
+        int length = messages[i].msg_len;
+        memcpy(buffer, batch_buffer.data() + i * packet_size, length);
+        if (length < packet_size) {
+            memset(buffer + length, 0, packet_size - length);
+        }
+        return count_packet(buffer);
+    }
+#else
+    return 0;
+#endif
+}
+
+void udp_stream::wait_for_data(int timeout_ms) {
+#ifdef __linux__
+    if (batch_next < batch_received) {
+        return;
+    }
+    struct pollfd pfd = {fd, POLLIN, 0};
+    poll(&pfd, 1, timeout_ms);
+#endif
+}
+
+// What's queued in the socket, including the kernel's per packet overhead, plus what's left of the batch
+uint64_t udp_stream::get_backlog() {
+    uint64_t backlog = (uint64_t)(batch_received - batch_next) * configuration::get_instance()->PACKET_SIZE;
+#if defined(__linux__) && defined(SO_MEMINFO)
+    uint32_t meminfo[SK_MEMINFO_VARS];
+    socklen_t length = sizeof(meminfo);
+    if (getsockopt(fd, SOL_SOCKET, SO_MEMINFO, meminfo, &length) == 0) {
+        backlog += meminfo[SK_MEMINFO_RMEM_ALLOC];
+    }
+#endif
+    return backlog;
+}
+
+void udp_stream::print_packet_numbers() {
+    packet_stream::print_packet_numbers();
+    std::cout << "UDP: received " << packets_received << " packets, " << kernel_drops << " dropped by the kernel, " << bad_size << " oversized" << std::endl;
+    auto time = TDatime();
+    kernel_drop_series->add(time.Convert(), kernel_drops);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "packet_stream.h"
+
+#include <TGraph.h>
+
+#include <cstdint>
+#include <vector>
+#ifdef __linux__
+#include <sys/socket.h>
+#endif
+
+// Receives the packets straight from the network instead of following the run file.
+// Datagrams are read UDP_BATCH at a time with recvmmsg into one preallocated buffer and
+// then handed out one by one, so there's one system call per batch instead of per packet.
+// Packets dropped by the kernel because the socket buffer was full are counted separately
+// from the ones the packet numbers say never arrived.
+class udp_stream : public packet_stream {
+private:
+    int fd;
+    int batch_size;
+    int batch_received;
+    int batch_next;
+    std::vector<uint8_t> batch_buffer;      // [packet * PACKET_SIZE]
+#ifdef __linux__
+    std::vector<mmsghdr> messages;
+    std::vector<iovec> iovecs;
+#endif
+    std::vector<char> control;              // Room for the kernel's drop counter, per packet
+    uint64_t kernel_drops;
+    uint64_t bad_size;
+    uint64_t packets_received;
+
+    TGraph *kernel_drop_graph;
+    timeseries *kernel_drop_series;
+
+    bool receive_batch();
+
+public:
+    udp_stream(int port);
+    ~udp_stream();
+    int read_packet(uint8_t *buffer) override;
+    void wait_for_data(int timeout_ms) override;
+    uint64_t get_backlog() override;
+    // There's always more to come from the network
+    bool finished() override {return false;}
+    void print_packet_numbers() override;
+};
@@ -0,0 +1,26 @@
+#include "waveform_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+waveform_ring::waveform_ring(int depth, int num_samples) {
+    this->depth = depth;
+    this->num_samples = num_samples;
+    written = 0;
+    samples = std::vector<uint32_t>((size_t)depth * num_samples, 0);
+    timestamps = std::vector<uint32_t>((size_t)depth * num_samples, 0);
+    found = std::vector<uint32_t>(depth, 0);
+    tot = std::vector<uint32_t>(depth, 0);
+    toa = std::vector<uint32_t>(depth, 0);
+}
+
+void waveform_ring::push(const uint32_t *event_timestamps, const uint32_t *event_samples, int n, uint32_t event_tot, uint32_t event_toa) {
+    int s = (int)(written % depth);
+    n = std::min(n, num_samples);
+    std::memcpy(samples.data() + (size_t)s * num_samples, event_samples, n * sizeof(uint32_t));
+    std::memcpy(timestamps.data() + (size_t)s * num_samples, event_timestamps, n * sizeof(uint32_t));
+    found[s] = n;
+    tot[s] = event_tot;
+    toa[s] = event_toa;
+    written++;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The last few raw waveforms of one channel, samples, timestamps and the largest TOT/TOA.
+// All storage is allocated up front and slots are overwritten oldest first, so pushing an
+// event is just a copy.  Nothing reads it unless someone asks for a channel's pulses.
+class waveform_ring {
+private:
+    int depth;
+    int num_samples;
+    uint64_t written;
+    std::vector<uint32_t> samples;      // [slot * num_samples + sample]
+    std::vector<uint32_t> timestamps;   // [slot * num_samples + sample]
+    std::vector<uint32_t> found;        // [slot]
+    std::vector<uint32_t> tot;          // [slot]
+    std::vector<uint32_t> toa;          // [slot]
+
+    // Slot of the i-th newest waveform
+    int slot(int i) {return (int)((written - 1 - i) % depth);}
+
+public:
+    waveform_ring(int depth, int num_samples);
+
+    void push(const uint32_t *event_timestamps, const uint32_t *event_samples, int n, uint32_t event_tot, uint32_t event_toa);
+    void reset() {written = 0;}
+
+    // Number of waveforms stored, i = 0 is the newest for all of the getters
+    int size() {return written < (uint64_t)depth ? (int)written : depth;}
+    const uint32_t *get_samples(int i) {return samples.data() + (size_t)slot(i) * num_samples;}
+    const uint32_t *get_timestamps(int i) {return timestamps.data() + (size_t)slot(i) * num_samples;}
+    int get_found(int i) {return found[slot(i)];}
+    uint32_t get_tot(int i) {return tot[slot(i)];}
+    uint32_t get_toa(int i) {return toa[slot(i)];}
+};